@@ -0,0 +1,17 @@
+QT += gui core concurrent
+QT -= widgets
+
+CONFIG += console c++11
+CONFIG -= app_bundle
+
+TARGET = renderer-bench
+
+include(../src/core.pri)
+
+SOURCES += \
+	main.cpp 
+
+DESTDIR = $$PWD/..
+BUILD_DIR = $$PWD/../build/bench
+OBJECTS_DIR = $${BUILD_DIR}
+MOC_DIR = $${BUILD_DIR}
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+#include <QSize>
+#include <QPoint>
+#include <QPainter>
+#include <QStringList>
+#include <QHash>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include "model.h"
+#include "scene.h"
+#include "renderer.h"
+
+namespace {
+    /* Stage names in the order they are reported */
+    const char* STAGES[] = {"obj", "tga", "mesh", "load", "vertex", "shadow", "shading", "present", "frame"};
+    const int NSTAGES = sizeof(STAGES) / sizeof(STAGES[0]);
+    /* Differences below this many milliseconds are timer noise */
+    const double NOISE_MS = 0.1;
+
+    class Workload {
+    public:
+        QString name;
+        QStringList models;
+    };
+
+    /* A camera path moves the eye by one step per frame, see Renderer::moveEye */
+    class CameraPath {
+    public:
+        QString name;
+        QPoint step(int frame) const {
+            if (name == "orbit") {
+                return QPoint(1, 0);
+            }
+            /* Tilt up and down by 30 degrees */
+            return QPoint(0, (frame / 6) % 4 == 1 || (frame / 6) % 4 == 2 ? -1 : 1);
+        }
+    };
+
+    double ms(qint64 ns) {
+        return ns / 1e6;
+    }
+
+    double median(QVector<double> v) {
+        if (v.isEmpty()) {
+            return 0;
+        }
+        std::sort(v.begin(), v.end());
+        return v.size() % 2 ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2;
+    }
+
+    QString key(const QJsonObject &result) {
+        return QString("%1 %2 %3x%4 t%5").arg(result["scene"].toString(), result["path"].toString())
+                .arg(result["width"].toInt()).arg(result["height"].toInt()).arg(result["threads"].toInt());
+    }
+
+    /* Load steps of every model one by one, then the whole workload through the thread pool */
+    QJsonObject measureLoad(const Workload &workload, int repeats) {
+        QVector<double> obj, tga, mesh, load;
+        QElapsedTimer timer;
+        for (int r = 0; r < repeats; ++r) {
+            Model::LoadTimings total;
+            for (int i = 0; i < workload.models.size(); ++i) {
+                Model model(workload.models[i].toStdString());
+                total.textures += model.loadTimings().textures;
+                total.parse += model.loadTimings().parse;
+                total.prepare += model.loadTimings().prepare;
+            }
+            obj.push_back(ms(total.parse));
+            tga.push_back(ms(total.textures));
+            mesh.push_back(ms(total.prepare));
+
+            timer.start();
+            Scene scene;
+            for (int i = 0; i < workload.models.size(); ++i) {
+                scene.addModel(workload.models[i]);
+            }
+            scene.waitForAssets();
+            load.push_back(ms(timer.nsecsElapsed()));
+        }
+        QJsonObject stages;
+        stages["obj"] = median(obj);
+        stages["tga"] = median(tga);
+        stages["mesh"] = median(mesh);
+        stages["load"] = median(load);
+        return stages;
+    }
+
+    QJsonObject run(const Workload &workload, const CameraPath &path, const QSize &size, int frames, QJsonObject stages) {
+        Scene scene;
+        for (int i = 0; i < workload.models.size(); ++i) {
+            scene.addInstance(scene.addModel(workload.models[i]));
+        }
+        scene.waitForAssets();
+
+        Renderer renderer(&scene, size.width(), size.height());
+        /* Warm up caches before measuring */
+        renderer.genFrame();
+        QElapsedTimer timer;
+        QImage surface(size, QImage::Format_ARGB32_Premultiplied);
+        QVector<double> vertex, shadow, shading, present, frame;
+        for (int f = 0; f < frames; ++f) {
+            renderer.moveEye(path.step(f));
+            timer.start();
+            QImage image = renderer.genFrame();
+            frame.push_back(ms(timer.nsecsElapsed()));
+            /* What the viewer does with a frame: draw it onto the window surface */
+            timer.start();
+            QPainter painter(&surface);
+            painter.drawImage(QPoint(0, 0), image);
+            painter.end();
+            present.push_back(ms(timer.nsecsElapsed()));
+            const Renderer::Timings &t = renderer.lastTimings();
+            vertex.push_back(ms(t.vertex));
+            shadow.push_back(ms(t.shadow));
+            shading.push_back(ms(t.shading));
+        }
+        stages["vertex"] = median(vertex);
+        stages["shadow"] = median(shadow);
+        stages["shading"] = median(shading);
+        stages["present"] = median(present);
+        stages["frame"] = median(frame);
+
+        QJsonObject res;
+        res["scene"] = workload.name;
+        res["path"] = path.name;
+        res["width"] = size.width();
+        res["height"] = size.height();
+        res["ms"] = stages;
+        return res;
+    }
+
+    void print(const QJsonObject &result) {
+        QJsonObject stages = result["ms"].toObject();
+        printf("%-36s", key(result).toLocal8Bit().constData());
+        for (int i = 0; i < NSTAGES; ++i) {
+            printf(" %9.2f", stages[STAGES[i]].toDouble());
+        }
+        printf("\n");
+    }
+
+    /* Returns the number of stages slower than the baseline by more than tolerance percent */
+    int compare(const QJsonArray &results, const QJsonArray &baseline, double tolerance) {
+        QHash<QString, QJsonObject> old;
+        for (int i = 0; i < baseline.size(); ++i) {
+            QJsonObject res = baseline[i].toObject();
+            old.insert(key(res), res["ms"].toObject());
+        }
+        int regressions = 0;
+        for (int i = 0; i < results.size(); ++i) {
+            QJsonObject res = results[i].toObject();
+            if (!old.contains(key(res))) {
+                std::cerr << "no baseline for " << key(res).toStdString() << "\n";
+                continue;
+            }
+            QJsonObject stages = res["ms"].toObject();
+            QJsonObject base = old.value(key(res));
+            for (int j = 0; j < NSTAGES; ++j) {
+                double now = stages[STAGES[j]].toDouble(), before = base[STAGES[j]].toDouble();
+                if (now - before > NOISE_MS && now > before * (1 + tolerance / 100)) {
+                    printf("REGRESSION %s %s: %.2f ms -> %.2f ms (%+.0f%%)\n", key(res).toLocal8Bit().constData(),
+                           STAGES[j], before, now, before > 0 ? (now / before - 1) * 100 : 100.0);
+                    regressions++;
+                } else if (before - now > NOISE_MS && now < before * (1 - tolerance / 100)) {
+                    printf("improved   %s %s: %.2f ms -> %.2f ms (%+.0f%%)\n", key(res).toLocal8Bit().constData(),
+                           STAGES[j], before, now, (now / before - 1) * 100);
+                }
+            }
+        }
+        return regressions;
+    }
+
+    QList<QSize> parseSizes(const QString &list) {
+        QList<QSize> res;
+        QStringList items = list.split(',', QString::SkipEmptyParts);
+        for (int i = 0; i < items.size(); ++i) {
+            QStringList wh = items[i].split('x');
+            if (wh.size() != 2 || wh[0].toInt() <= 0 || wh[1].toInt() <= 0) {
+                std::cerr << "bad resolution " << items[i].toStdString() << "\n";
+                continue;
+            }
+            res.push_back(QSize(wh[0].toInt(), wh[1].toInt()));
+        }
+        return res;
+    }
+
+    QList<int> parseInts(const QString &list) {
+        QList<int> res;
+        QStringList items = list.split(',', QString::SkipEmptyParts);
+        for (int i = 0; i < items.size(); ++i) {
+            int n = items[i].toInt();
+            if (n > 0 && !res.contains(n)) {
+                res.push_back(n);
+            }
+        }
+        return res;
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the rendering pipeline stages over fixed camera paths.");
+    parser.addHelpOption();
+    QCommandLineOption models_option("models", "Directory with the bundled models.", "dir", "models");
+    parser.addOption(models_option);
+    QCommandLineOption sizes_option("resolutions", "Comma separated list of <WxH> frame sizes.", "sizes",
+                                    "640x480,1280x720,1920x1080");
+    parser.addOption(sizes_option);
+    QCommandLineOption threads_option("threads", "Comma separated list of thread pool sizes.", "counts",
+                                      QString("1,%1").arg(QThread::idealThreadCount()));
+    parser.addOption(threads_option);
+    QCommandLineOption frames_option("frames", "Measured frames per camera path.", "n", "24");
+    parser.addOption(frames_option);
+    QCommandLineOption loads_option("loads", "Measured loads of every workload.", "n", "3");
+    parser.addOption(loads_option);
+    QCommandLineOption output_option("output", "Write the results as JSON to <file>.", "file");
+    parser.addOption(output_option);
+    QCommandLineOption baseline_option("baseline", "Compare against the results stored in <file>.", "file");
+    parser.addOption(baseline_option);
+    QCommandLineOption tolerance_option("tolerance", "Allowed slowdown against the baseline in percent.", "percent", "10");
+    parser.addOption(tolerance_option);
+    parser.process(app);
+
+    QString dir = parser.value(models_option);
+    QVector<Workload> workloads(2);
+    workloads[0].name = "african_head";
+    workloads[0].models << dir + "/african_head/african_head.obj" << dir + "/african_head/african_head_eye_inner.obj";
+    workloads[1].name = "diablo3_pose";
+    workloads[1].models << dir + "/diablo3/diablo3_pose.obj";
+    QVector<CameraPath> paths(2);
+    paths[0].name = "orbit";
+    paths[1].name = "tilt";
+    QList<QSize> sizes = parseSizes(parser.value(sizes_option));
+    QList<int> threads = parseInts(parser.value(threads_option));
+    int frames = std::max(1, parser.value(frames_option).toInt());
+    int loads = std::max(1, parser.value(loads_option).toInt());
+
+    printf("%-36s", "all times in ms, per-frame medians");
+    for (int i = 0; i < NSTAGES; ++i) {
+        printf(" %9s", STAGES[i]);
+    }
+    printf("\n");
+    QJsonArray results;
+    for (int w = 0; w < workloads.size(); ++w) {
+        for (int t = 0; t < threads.size(); ++t) {
+            QThreadPool::globalInstance()->setMaxThreadCount(threads[t]);
+            QJsonObject load = measureLoad(workloads[w], loads);
+            for (int p = 0; p < paths.size(); ++p) {
+                for (int s = 0; s < sizes.size(); ++s) {
+                    QJsonObject res = run(workloads[w], paths[p], sizes[s], frames, load);
+                    res["threads"] = threads[t];
+                    print(res);
+                    results.append(res);
+                }
+            }
+        }
+    }
+
+    QJsonObject report;
+    report["frames"] = frames;
+    report["results"] = results;
+    if (parser.isSet(output_option)) {
+        QFile file(parser.value(output_option));
+        if (!file.open(QIODevice::WriteOnly)) {
+            std::cerr << "can't write " << parser.value(output_option).toStdString() << "\n";
+            return 2;
+        }
+        file.write(QJsonDocument(report).toJson());
+    }
+    if (parser.isSet(baseline_option)) {
+        QFile file(parser.value(baseline_option));
+        if (!file.open(QIODevice::ReadOnly)) {
+            std::cerr << "can't read " << parser.value(baseline_option).toStdString() << "\n";
+            return 2;
+        }
+        QJsonArray baseline = QJsonDocument::fromJson(file.readAll()).object()["results"].toArray();
+        int regressions = compare(results, baseline, parser.value(tolerance_option).toDouble());
+        printf("%d regression(s) against %s\n", regressions, parser.value(baseline_option).toLocal8Bit().constData());
+        return regressions ? 1 : 0;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -1,4 +1,4 @@
-QT += widgets gui core
+QT += widgets gui core concurrent network
 
 CONFIG += console c++11
 CONFIG -= app_bundle
@@ -7,22 +7,19 @@ DEFINES -= QT_NO_DEBUG_OUTPUT
 DEPENDPATH += .
 INCLUDEPATH += .
 
+include(src/core.pri)
+
 SOURCES += \
 	src/main.cpp \
+	src/options.cpp \
+	src/renderserver.cpp \
 	src/mainwindow.cpp \
-	src/mainwidget.cpp \
-	src/model.cpp \
-	src/image.cpp \
-	src/simplegl.cpp \
-	src/renderer.cpp 
+	src/mainwidget.cpp 
 HEADERS += \
+	src/options.h \
+	src/renderserver.h \
 	src/mainwindow.h \
-	src/mainwidget.h \
-	src/geometry.h \
-	src/model.h \
-	src/image.h \
-	src/simplegl.h \
-	src/renderer.h 
+	src/mainwidget.h 
 
 DESTDIR = .
 PROJECT_DIR = $$_PRO_FILE_PWD_
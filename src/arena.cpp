@@ -0,0 +1,68 @@
+#include <QtGlobal>
+
+#include <algorithm>
+
+#include "arena.h"
+
+gl::Arena::Arena(size_t block_size): block_size(block_size), blocks(NULL), offset(0), used_before(0) {}
+
+gl::Arena::~Arena() {
+    release();
+}
+
+void* gl::Arena::allocate(size_t bytes) {
+    size_t start = (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (!blocks || start + bytes > blocks->size) {
+        addBlock(std::max(block_size, bytes));
+        start = 0;
+    }
+    offset = start + bytes;
+    return blocks->data + start;
+}
+
+void gl::Arena::addBlock(size_t size) {
+    if (blocks) {
+        used_before += offset;
+    }
+    /* The block header sits in front of its data */
+    size_t header = (sizeof(Block) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    char* memory = static_cast<char*>(qMallocAligned(header + size, ALIGNMENT));
+    Q_CHECK_PTR(memory);
+    Block* block = reinterpret_cast<Block*>(memory);
+    block->data = memory + header;
+    block->size = size;
+    block->next = blocks;
+    blocks = block;
+    offset = 0;
+}
+
+void gl::Arena::reset() {
+    if (blocks && blocks->next) {
+        /* Several blocks were needed, replace them by one that fits all of it next time */
+        size_t total = capacity();
+        release();
+        addBlock(total);
+    }
+    offset = 0;
+    used_before = 0;
+}
+
+size_t gl::Arena::used() const {
+    return used_before + offset;
+}
+
+size_t gl::Arena::capacity() const {
+    size_t res = 0;
+    for (Block* block = blocks; block; block = block->next) {
+        res += block->size;
+    }
+    return res;
+}
+
+void gl::Arena::release() {
+    while (blocks) {
+        Block* next = blocks->next;
+        qFreeAligned(blocks);
+        blocks = next;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+
+namespace gl {
+    /*
+     * Bump allocator for data that lives until the next reset(). Blocks are kept across resets and merged
+     * into one as large as everything used before, so a steady frame loop stops calling the heap.
+     * Memory is not initialized and nothing is destroyed, it is meant for plain data.
+     */
+    class Arena {
+    public:
+        Arena(size_t block_size = 64 * 1024);
+        ~Arena();
+
+        template<typename T>
+        T* alloc(size_t n) {
+            return static_cast<T*>(allocate(n * sizeof(T)));
+        }
+        /* Invalidates everything allocated so far */
+        void reset();
+        size_t used() const;
+        size_t capacity() const;
+    private:
+        /* Every allocation is aligned for AVX loads */
+        static const size_t ALIGNMENT = 32;
+
+        class Block {
+        public:
+            char* data;
+            size_t size;
+            Block* next;
+        };
+
+        Arena(const Arena&);
+        Arena& operator=(const Arena&);
+        void* allocate(size_t bytes);
+        void addBlock(size_t size);
+        void release();
+
+        size_t block_size;
+        /* Newest block first, allocations come from the head */
+        Block* blocks;
+        size_t offset;
+        /* Bytes in the blocks before the head */
+        size_t used_before;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include <QMutexLocker>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include "assetcache.h"
+
+AssetCache::Entry::Entry(): loading(false), bytes(0), last_use(0) {}
+
+AssetCache::AssetCache(qint64 budget): budget(budget), clock(0) {}
+
+namespace {
+    /* Changes when the file is edited, a missing file has a stamp of its own */
+    QString stamp(const QString &filename) {
+        QFileInfo file(filename);
+        return filename + "|" + QString::number(file.lastModified().toMSecsSinceEpoch()) + "|" + QString::number(file.size());
+    }
+}
+
+QString AssetCache::key(const QString &filename, const Material &material) {
+    /* The same mesh with other textures is another model, editing the mesh or a texture makes it stale */
+    Material files = Model::textureFiles(filename.toStdString(), material);
+    return stamp(filename) + "|" + stamp(QString::fromStdString(files.diffuse)) + "|" + stamp(QString::fromStdString(files.normal_map))
+           + "|" + stamp(QString::fromStdString(files.specular)) + "|" + stamp(QString::fromStdString(files.glow));
+}
+
+QSharedPointer<Model> AssetCache::load(const QString &filename, const Material &material) {
+    QString k = key(filename, material);
+    QMutexLocker lock(&mutex);
+    while (entries.contains(k)) {
+        Entry &entry = entries[k];
+        if (entry.loading) {
+            loaded.wait(&mutex);
+            continue;
+        }
+        QSharedPointer<Model> model = entry.model.toStrongRef();
+        if (!model) {
+            /* Evicted, read it again */
+            entries.remove(k);
+            break;
+        }
+        entry.retained = model;
+        entry.last_use = ++clock;
+        return model;
+    }
+    entries[k].loading = true;
+    lock.unlock();
+    QSharedPointer<Model> model(new Model(filename.toStdString(), material));
+    lock.relock();
+    Entry &entry = entries[k];
+    entry.loading = false;
+    entry.model = model;
+    entry.retained = model;
+    entry.bytes = model->memoryUsage();
+    entry.last_use = ++clock;
+    evict();
+    loaded.wakeAll();
+    return model;
+}
+
+void AssetCache::setBudget(qint64 budget) {
+    QMutexLocker lock(&mutex);
+    this->budget = budget;
+    evict();
+}
+
+void AssetCache::evict() {
+    qint64 total = 0;
+    for (QHash<QString, Entry>::iterator it = entries.begin(); it != entries.end(); ) {
+        if (!it->loading && it->model.isNull()) {
+            it = entries.erase(it);
+        } else {
+            total += it->bytes;
+            ++it;
+        }
+    }
+    while (budget > 0 && total > budget) {
+        QHash<QString, Entry>::iterator lru = entries.end();
+        for (QHash<QString, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+            if (it->retained && (lru == entries.end() || it->last_use < lru->last_use)) {
+                lru = it;
+            }
+        }
+        if (lru == entries.end()) {
+            return;
+        }
+        lru->retained.clear();
+        if (lru->model.isNull()) {
+            total -= lru->bytes;
+            entries.erase(lru);
+        }
+    }
+}
+
+int AssetCache::size() const {
+    QMutexLocker lock(&mutex);
+    int res = 0;
+    for (QHash<QString, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        res += !it->model.isNull();
+    }
+    return res;
+}
+
+qint64 AssetCache::bytes() const {
+    QMutexLocker lock(&mutex);
+    qint64 res = 0;
+    for (QHash<QString, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        res += it->model.isNull() ? 0 : it->bytes;
+    }
+    return res;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSharedPointer>
+#include <QWeakPointer>
+
+#include "model.h"
+
+/*
+ * Models shared by every scene created with the cache, so a long-running process reads each asset once.
+ * Models not used by any scene are kept until their memory is needed: when the loaded models exceed the budget,
+ * the least recently requested ones are dropped. One still used by a scene is freed as soon as the scene lets go of it.
+ * Safe to use from any thread, a model requested while another thread loads it waits for that load.
+ */
+class AssetCache {
+public:
+    /* Budget in bytes, 0 keeps everything */
+    AssetCache(qint64 budget = 0);
+    QSharedPointer<Model> load(const QString &filename, const Material &material = Material());
+    void setBudget(qint64 budget);
+    /* Models in memory and the bytes they take, whether a scene uses them or not */
+    int size() const;
+    qint64 bytes() const;
+private:
+    class Entry {
+    public:
+        Entry();
+        QWeakPointer<Model> model;
+        /* Keeps the model alive while no scene uses it, cleared on eviction */
+        QSharedPointer<Model> retained;
+        bool loading;
+        qint64 bytes;
+        qint64 last_use;
+    };
+
+    AssetCache(const AssetCache&);
+    AssetCache& operator=(const AssetCache&);
+    /* Paths, times and sizes of the mesh and of every texture it reads, so edited files are read again */
+    static QString key(const QString &filename, const Material &material);
+    /* Called with the mutex held */
+    void evict();
+
+    mutable QMutex mutex;
+    QWaitCondition loaded;
+    QHash<QString, Entry> entries;
+    qint64 budget;
+    qint64 clock;
+};
\ No newline at end of file
@@ -0,0 +1,54 @@
+#include <cassert>
+#include <algorithm>
+
+#include "blend.h"
+
+gl::BlendBuffer::BlendBuffer(int width, int height)
+        : w(width), h(height), accum(width * height, Vec4f(0, 0, 0, 0)), revealage(width * height, 1.0f),
+          x0(height, width), x1(height, -1) {}
+
+void gl::BlendBuffer::clear(int first, int last) {
+    for (int y = first; y <= last; ++y) {
+        if (x0[y] > x1[y]) {
+            continue;
+        }
+        std::fill(accum.begin() + y * w + x0[y], accum.begin() + y * w + x1[y] + 1, Vec4f(0, 0, 0, 0));
+        std::fill(revealage.begin() + y * w + x0[y], revealage.begin() + y * w + x1[y] + 1, 1.0f);
+        x0[y] = w;
+        x1[y] = -1;
+    }
+}
+
+void gl::BlendBuffer::add(int x, int y, QRgb color, float depth) {
+    float alpha = qAlpha(color) / 255.0f;
+    if (alpha <= 0) {
+        return;
+    }
+    x0[y] = std::min(x0[y], x);
+    x1[y] = std::max(x1[y], x);
+    /* The depth weight of the paper, nearer layers dominate the average */
+    float d = std::min(1.0f, std::max(0.0f, depth));
+    float weight = alpha * std::max(1e-2f, 3e3f * d * d * d);
+    accum[x + y * w] += Vec4f(qRed(color) * alpha, qGreen(color) * alpha, qBlue(color) * alpha, alpha) * weight;
+    revealage[x + y * w] *= 1.0f - alpha;
+}
+
+void gl::BlendBuffer::resolve(Framebuffer &target, int first, int last) const {
+    assert(target.width == w && target.height == h);
+    for (int y = first; y <= last; ++y) {
+        QRgb* line = target.pixels + y * target.stride;
+        for (int x = x0[y]; x <= x1[y]; ++x) {
+            const Vec4f &a = accum[x + y * w];
+            float reveal = revealage[x + y * w];
+            if (reveal == 1.0f) {
+                continue;
+            }
+            /* Average color of the layers over what they let through */
+            Vec4f avg = a / std::max(a[3], 1e-5f);
+            QRgb dst = line[x];
+            line[x] = qRgb(avg[0] * (1 - reveal) + qRed(dst) * reveal + 0.5f,
+                           avg[1] * (1 - reveal) + qGreen(dst) * reveal + 0.5f,
+                           avg[2] * (1 - reveal) + qBlue(dst) * reveal + 0.5f);
+        }
+    }
+}
\ No newline at end of file
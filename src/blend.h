@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QImage>
+#include <QVector>
+
+#include "geometry.h"
+#include "framebuffer.h"
+
+namespace gl {
+    /*
+     * Weighted blended order-independent transparency (McGuire and Bavoil, 2013). Transparent fragments are
+     * summed in any order with a weight that falls off with distance, then composited over the opaque image
+     * in one step, so transparent triangles never have to be sorted.
+     */
+    class BlendBuffer {
+    public:
+        BlendBuffer(int width, int height);
+
+        int width() const { return w; }
+        int height() const { return h; }
+
+        /* Works on rows first to last, only the pixels touched since they were cleared are cleared */
+        void clear(int first, int last);
+        /* Color with straight alpha, depth in [0, 1] with 1 nearest to the eye */
+        void add(int x, int y, QRgb color, float depth);
+        /* Composites rows first to last over the color of a target of the same size */
+        void resolve(Framebuffer &target, int first, int last) const;
+    private:
+        int w, h;
+        /* Weighted premultiplied color and weighted alpha */
+        QVector<Vec4f> accum;
+        /* Product of (1 - alpha) of the layers, the share of the opaque color left */
+        QVector<float> revealage;
+        /* Columns touched in every row, so bands of rows never share them */
+        QVector<int> x0, x1;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+# Rendering core shared by the viewer and the benchmark
+INCLUDEPATH += $$PWD
+
+# qmake CONFIG+=stats collects pipeline counters, see stats.h
+stats: DEFINES += RENDERER_STATS
+
+SOURCES += \
+	$$PWD/model.cpp \
+	$$PWD/meshopt.cpp \
+	$$PWD/scene.cpp \
+	$$PWD/assetcache.cpp \
+	$$PWD/image.cpp \
+	$$PWD/arena.cpp \
+	$$PWD/taskgraph.cpp \
+	$$PWD/framebuffer.cpp \
+	$$PWD/simplegl.cpp \
+	$$PWD/light.cpp \
+	$$PWD/multisample.cpp \
+	$$PWD/blend.cpp \
+	$$PWD/ssao.cpp \
+	$$PWD/stats.cpp \
+	$$PWD/framewriter.cpp \
+	$$PWD/renderer.cpp 
+HEADERS += \
+	$$PWD/geometry.h \
+	$$PWD/model.h \
+	$$PWD/meshopt.h \
+	$$PWD/scene.h \
+	$$PWD/assetcache.h \
+	$$PWD/image.h \
+	$$PWD/arena.h \
+	$$PWD/taskgraph.h \
+	$$PWD/framebuffer.h \
+	$$PWD/simplegl.h \
+	$$PWD/light.h \
+	$$PWD/multisample.h \
+	$$PWD/blend.h \
+	$$PWD/ssao.h \
+	$$PWD/stats.h \
+	$$PWD/framewriter.h \
+	$$PWD/renderer.h 
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+#include "framebuffer.h"
+#include "simplegl.h"
+#include "stats.h"
+
+gl::Framebuffer::Framebuffer(QImage* image, float* zbuffer, int width, int height)
+        : width(width), height(height), pixels((QRgb*)image->bits()), stride(image->bytesPerLine() / sizeof(QRgb)),
+          zbuffer(zbuffer) {}
+
+void gl::Framebuffer::clear(int first, int last) {
+    std::fill(zbuffer + first * width, zbuffer + (last + 1) * width, -std::numeric_limits<float>::max());
+    for (int y = first; y <= last; ++y) {
+        std::fill(pixels + y * stride, pixels + y * stride + width, qRgb(0, 0, 0));
+    }
+}
+
+gl::DepthBuffer::DepthBuffer(): w(0), h(0), nbits(32), unit(0) {}
+
+bool gl::DepthBuffer::isSupported(int bits) {
+    return bits == 16 || bits == 24 || bits == 32;
+}
+
+void gl::DepthBuffer::resize(int width, int height, int bits) {
+    w = width;
+    h = height;
+    nbits = bits;
+    unit = bits == 32 ? 0 : 1 / scale();
+    /* Only the storage in use keeps its memory */
+    float_depth.resize(bits == 32 ? w * h : 0);
+    short_depth.resize(bits == 16 ? w * h : 0);
+    word_depth.resize(bits == 24 ? w * h : 0);
+    float_depth.squeeze();
+    short_depth.squeeze();
+    word_depth.squeeze();
+}
+
+float gl::DepthBuffer::scale() const {
+    return (maximum() - 1) / float(DEPTH);
+}
+
+void gl::DepthBuffer::clear(int first, int last) {
+    int begin = first * w, end = (last + 1) * w;
+    if (nbits == 16) {
+        memset(short_depth.data() + begin, 0, (end - begin) * sizeof(quint16));
+    } else if (nbits == 24) {
+        memset(word_depth.data() + begin, 0, (end - begin) * sizeof(quint32));
+    } else {
+        std::fill(float_depth.data() + begin, float_depth.data() + end, -std::numeric_limits<float>::max());
+    }
+}
+
+qint64 gl::DepthBuffer::covered(int first, int last) const {
+    int begin = first * w, end = (last + 1) * w;
+    if (nbits == 32) {
+        return Stats::covered(float_depth.constData() + begin, end - begin);
+    }
+    qint64 res = 0;
+    for (int i = begin; i < end; ++i) {
+        res += (nbits == 16 ? short_depth[i] : word_depth[i]) != 0;
+    }
+    return res;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QImage>
+#include <QVector>
+
+#include <limits>
+
+namespace gl {
+    /*
+     * Color and depth rows a pass draws to. The image detaches once, when this is made, so bands of rows can be
+     * drawn from several threads.
+     */
+    class Framebuffer {
+    public:
+        Framebuffer(QImage* image, float* zbuffer, int width, int height);
+        /* Rows first to last become black and as far as possible */
+        void clear(int first, int last);
+
+        int width, height;
+        QRgb* pixels;
+        int stride;
+        float* zbuffer;
+    };
+
+    /*
+     * Depth of a pass that keeps nothing else, such as a shadow map. Besides floats it can hold 16 or 24 bit
+     * fixed point depth, which halves the memory a pass streams through or keeps it the same with exact steps.
+     * Fixed point values are zero when cleared and 1 to maximum() over depths 0 to DEPTH, nearer is larger.
+     */
+    class DepthBuffer {
+    public:
+        DepthBuffer();
+        /* 16 and 24 are fixed point, 32 is float */
+        static bool isSupported(int bits);
+
+        /* Contents are undefined until cleared */
+        void resize(int width, int height, int bits);
+        int width() const { return w; }
+        int height() const { return h; }
+        int bits() const { return nbits; }
+        /* Largest fixed point value and fixed point steps per unit of depth, only for fixed point */
+        quint32 maximum() const { return quint32((quint64(1) << nbits) - 1); }
+        float scale() const;
+
+        /* Rows first to last become as far as possible */
+        void clear(int first, int last);
+        /* Decoded, as far as possible where nothing was drawn */
+        float depth(int x, int y) const {
+            if (nbits == 32) {
+                return float_depth[x + y * w];
+            }
+            quint32 q = nbits == 16 ? short_depth[x + y * w] : word_depth[x + y * w];
+            return q ? (q - 1) * unit : -std::numeric_limits<float>::max();
+        }
+        /* Pixels drawn to in rows first to last */
+        qint64 covered(int first, int last) const;
+
+        /* Only the one matching bits() has data, 24 bit depth is kept in 32 bit words */
+        float* floats() { return float_depth.data(); }
+        quint16* shorts() { return short_depth.data(); }
+        quint32* words() { return word_depth.data(); }
+    private:
+        int w, h, nbits;
+        /* Depth of one fixed point step */
+        float unit;
+        QVector<float> float_depth;
+        QVector<quint16> short_depth;
+        QVector<quint32> word_depth;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include <QtConcurrent>
+#include <QFileInfo>
+#include <QDir>
+
+#include <iostream>
+
+#include "framewriter.h"
+
+FrameWriter::FrameWriter(const QString &path, int fps): path(path), format(SEQUENCE), fps(fps), count(0), failed(false) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "y4m") {
+        format = Y4M;
+    } else if (suffix == "rgb") {
+        format = RAW;
+    }
+    QDir().mkpath(QFileInfo(path).path());
+    if (format != SEQUENCE) {
+        stream.setFileName(path);
+        if (!stream.open(QIODevice::WriteOnly)) {
+            std::cerr << "can't write " << path.toStdString() << "\n";
+            failed = true;
+        }
+    }
+}
+
+FrameWriter::~FrameWriter() {
+    close();
+}
+
+bool FrameWriter::write(const QVector<QImage> &frames) {
+    pending.waitForFinished();
+    if (failed) {
+        return false;
+    }
+    /* QImage is implicitly shared, the renderer allocates a new image for every frame so nothing is copied */
+    pending = QtConcurrent::run(this, &FrameWriter::encodeBatch, frames, count);
+    count += frames.size();
+    return true;
+}
+
+bool FrameWriter::close() {
+    pending.waitForFinished();
+    if (stream.isOpen()) {
+        stream.close();
+    }
+    return !failed;
+}
+
+int FrameWriter::frames() const {
+    return count;
+}
+
+QString FrameWriter::framePath(int index) const {
+    int end = path.lastIndexOf('#') + 1;
+    if (end == 0) {
+        /* No placeholder, number the frames before the suffix */
+        QString suffix = QFileInfo(path).suffix();
+        return path.left(path.size() - suffix.size() - 1) + QString("_%1.").arg(index, 4, 10, QChar('0')) + suffix;
+    }
+    int start = end - 1;
+    for (; start > 0 && path[start - 1] == '#'; --start);
+    return path.left(start) + QString("%1").arg(index, end - start, 10, QChar('0')) + path.mid(end);
+}
+
+void FrameWriter::encodeBatch(QVector<QImage> frames, int first) {
+    for (int i = 0; i < frames.size() && !failed; ++i) {
+        encode(frames[i], first + i);
+    }
+}
+
+void FrameWriter::encode(QImage frame, int index) {
+    if (format == SEQUENCE) {
+        QString file = framePath(index);
+        if (!frame.save(file)) {
+            std::cerr << "can't write " << file.toStdString() << "\n";
+            failed = true;
+        }
+        return;
+    }
+    frame = frame.convertToFormat(QImage::Format_RGB32);
+    int w = frame.width(), h = frame.height();
+    buffer.clear();
+    if (format == Y4M) {
+        if (index == 0) {
+            buffer += QString("YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1 C444\n").arg(w).arg(h).arg(fps).toLatin1();
+        }
+        buffer += "FRAME\n";
+        /* Planar BT.601 with studio swing, which is what players assume for y4m */
+        int offset = buffer.size();
+        buffer.resize(offset + 3 * w * h);
+        uchar* y_plane = (uchar*)buffer.data() + offset;
+        uchar* u_plane = y_plane + w * h;
+        uchar* v_plane = u_plane + w * h;
+        for (int y = 0; y < h; ++y) {
+            const QRgb* line = (const QRgb*)frame.constScanLine(y);
+            for (int x = 0; x < w; ++x, ++y_plane, ++u_plane, ++v_plane) {
+                int r = qRed(line[x]), g = qGreen(line[x]), b = qBlue(line[x]);
+                *y_plane = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+                *u_plane = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+                *v_plane = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+            }
+        }
+    } else {
+        buffer.resize(3 * w * h);
+        uchar* dst = (uchar*)buffer.data();
+        for (int y = 0; y < h; ++y) {
+            const QRgb* line = (const QRgb*)frame.constScanLine(y);
+            for (int x = 0; x < w; ++x) {
+                *dst++ = qRed(line[x]);
+                *dst++ = qGreen(line[x]);
+                *dst++ = qBlue(line[x]);
+            }
+        }
+    }
+    if (stream.write(buffer) != buffer.size()) {
+        std::cerr << "can't write " << path.toStdString() << "\n";
+        failed = true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QString>
+#include <QImage>
+#include <QVector>
+#include <QFile>
+#include <QFuture>
+#include <QByteArray>
+
+/*
+ * Writes rendered frames to disk on the thread pool while the caller renders the next ones.
+ * The path picks the format: an image sequence (.png or .ppm, the last run of '#' becomes the frame number),
+ * a YUV4MPEG2 video (.y4m, 4:4:4) or raw RGB24 frames (.rgb). At most one batch of frames is in flight.
+ */
+class FrameWriter {
+public:
+    enum Format {
+        SEQUENCE, Y4M, RAW
+    };
+
+    FrameWriter(const QString &path, int fps = 25);
+    ~FrameWriter();
+    /* Queues frames to be written in order, waits for the previous batch first; false if writing failed so far */
+    bool write(const QVector<QImage> &frames);
+    /* Waits for the last frame and closes the stream */
+    bool close();
+    int frames() const;
+private:
+    FrameWriter(const FrameWriter&);
+    FrameWriter& operator=(const FrameWriter&);
+    void encodeBatch(QVector<QImage> frames, int first);
+    void encode(QImage frame, int index);
+    QString framePath(int index) const;
+
+    QString path;
+    Format format;
+    int fps;
+    QFile stream;
+    QFuture<void> pending;
+    int count;
+    /* Only touched by the writing thread until pending finishes */
+    bool failed;
+    QByteArray buffer;
+};
\ No newline at end of file
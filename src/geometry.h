@@ -2,9 +2,18 @@
 
 #include <cmath>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
 #include <iomanip>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define GEOMETRY_SSE
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
 template<size_t DIM, typename T>
 class Vec {
 public:
@@ -102,6 +111,78 @@ public:
     T x, y, z; 
 };
 
+#ifdef GEOMETRY_SSE
+/* Vec4f lives in a single SSE register, so dot products and sums take a handful of instructions */
+template<>
+class alignas(16) Vec<4, float> {
+public:
+    Vec(): v(_mm_setzero_ps()) {}
+
+    Vec(float x, float y, float z, float w): v(_mm_setr_ps(x, y, z, w)) {}
+
+    explicit Vec(__m128 v): v(v) {}
+
+    float& operator[](size_t i) {
+        assert(i < 4);
+        return raw[i];
+    }
+
+    const float& operator[](size_t i) const {
+        assert(i < 4);
+        return raw[i];
+    }
+
+    float len() const;
+
+    Vec<4, float>& normalize(float l = 1);
+
+    union {
+        __m128 v;
+        float raw[4];
+    };
+};
+
+inline float hsum(__m128 v) {
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+inline float operator*(const Vec<4, float> &a, const Vec<4, float> &b) {
+    return hsum(_mm_mul_ps(a.v, b.v));
+}
+
+inline Vec<4, float> operator+(const Vec<4, float> &a, const Vec<4, float> &b) {
+    return Vec<4, float>(_mm_add_ps(a.v, b.v));
+}
+
+inline Vec<4, float> operator-(const Vec<4, float> &a, const Vec<4, float> &b) {
+    return Vec<4, float>(_mm_sub_ps(a.v, b.v));
+}
+
+inline Vec<4, float> operator*(const Vec<4, float> &a, float factor) {
+    return Vec<4, float>(_mm_mul_ps(a.v, _mm_set1_ps(factor)));
+}
+
+inline Vec<4, float> operator*(float factor, const Vec<4, float> &a) {
+    return a * factor;
+}
+
+inline Vec<4, float> operator/(const Vec<4, float> &a, float c) {
+    return Vec<4, float>(_mm_div_ps(a.v, _mm_set1_ps(c)));
+}
+
+inline float Vec<4, float>::len() const {
+    return std::sqrt((*this) * (*this));
+}
+
+inline Vec<4, float>& Vec<4, float>::normalize(float l) {
+    *this = (*this) * (l / len());
+    return *this;
+}
+#endif
+
 template<size_t DIM, typename T>
 T operator*(const Vec<DIM, T>& a, const Vec<DIM, T> &b) {
     T res = T();
@@ -282,6 +363,138 @@ public:
     }
 };
 
+#ifdef GEOMETRY_SSE
+/* 4x4 float matrix stored as four SSE rows with closed-form determinant and inverse */
+template<>
+class alignas(16) Matr<4, 4, float> {
+private:
+    Vec<4, float> data[4];
+public:
+    Matr() {}
+
+    Vec<4, float>& operator[](size_t i) {
+        assert(i < 4);
+        return data[i];
+    }
+
+    const Vec<4, float>& operator[](size_t i) const {
+        assert(i < 4);
+        return data[i];
+    }
+
+    Vec<4, float> col(size_t j) const {
+        assert(j < 4);
+        return Vec<4, float>(data[0][j], data[1][j], data[2][j], data[3][j]);
+    }
+
+    void setCol(size_t j, const Vec<4, float> &v) {
+        assert(j < 4);
+        for (size_t i = 4; i--; data[i][j] = v[i]);
+    }
+
+    static Matr<4, 4, float> identity() {
+        Matr<4, 4, float> res;
+        for (size_t i = 4; i--; res[i][i] = 1);
+        return res;
+    }
+
+    Matr<3, 3, float> getMinor(size_t row, size_t col) const {
+        Matr<3, 3, float> res;
+        for (size_t i = 3; i--; ) {
+            for (size_t j = 3; j--; res[i][j] = data[i + (i >= row)][j + (j >= col)]);
+        }
+        return res;
+    }
+
+    float det() const;
+
+    float cofactor(size_t i, size_t j) const {
+        return getMinor(i, j).det() * ((i + j) % 2 ? -1 : 1);
+    }
+
+    Matr<4, 4, float> adjugate() const {
+        return adjugateTranspose().transpose();
+    }
+
+    Matr<4, 4, float> invertTranspose() const {
+        return invert().transpose();
+    }
+
+    Matr<4, 4, float> transpose() const {
+        Matr<4, 4, float> res = *this;
+        _MM_TRANSPOSE4_PS(res.data[0].v, res.data[1].v, res.data[2].v, res.data[3].v);
+        return res;
+    }
+
+    Matr<4, 4, float> invert() const {
+        float d;
+        Matr<4, 4, float> res = adjugateTranspose(&d);
+        __m128 inv_det = _mm_set1_ps(1.0f / d);
+        for (size_t i = 4; i--; res.data[i].v = _mm_mul_ps(res.data[i].v, inv_det));
+        return res;
+    }
+private:
+    /* Transposed cofactor matrix from 2x2 sub-determinants (Laplace expansion along the row pairs) */
+    Matr<4, 4, float> adjugateTranspose(float* det = NULL) const;
+};
+
+inline Matr<4, 4, float> Matr<4, 4, float>::adjugateTranspose(float* det) const {
+    const Matr<4, 4, float> &a = *this;
+    float s0 = a[0][0] * a[1][1] - a[1][0] * a[0][1];
+    float s1 = a[0][0] * a[1][2] - a[1][0] * a[0][2];
+    float s2 = a[0][0] * a[1][3] - a[1][0] * a[0][3];
+    float s3 = a[0][1] * a[1][2] - a[1][1] * a[0][2];
+    float s4 = a[0][1] * a[1][3] - a[1][1] * a[0][3];
+    float s5 = a[0][2] * a[1][3] - a[1][2] * a[0][3];
+    float c5 = a[2][2] * a[3][3] - a[3][2] * a[2][3];
+    float c4 = a[2][1] * a[3][3] - a[3][1] * a[2][3];
+    float c3 = a[2][1] * a[3][2] - a[3][1] * a[2][2];
+    float c2 = a[2][0] * a[3][3] - a[3][0] * a[2][3];
+    float c1 = a[2][0] * a[3][2] - a[3][0] * a[2][2];
+    float c0 = a[2][0] * a[3][1] - a[3][0] * a[2][1];
+    if (det) {
+        *det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    }
+    Matr<4, 4, float> res;
+    res[0] = Vec<4, float>(a[1][1] * c5 - a[1][2] * c4 + a[1][3] * c3, -a[0][1] * c5 + a[0][2] * c4 - a[0][3] * c3,
+                           a[3][1] * s5 - a[3][2] * s4 + a[3][3] * s3, -a[2][1] * s5 + a[2][2] * s4 - a[2][3] * s3);
+    res[1] = Vec<4, float>(-a[1][0] * c5 + a[1][2] * c2 - a[1][3] * c1, a[0][0] * c5 - a[0][2] * c2 + a[0][3] * c1,
+                           -a[3][0] * s5 + a[3][2] * s2 - a[3][3] * s1, a[2][0] * s5 - a[2][2] * s2 + a[2][3] * s1);
+    res[2] = Vec<4, float>(a[1][0] * c4 - a[1][1] * c2 + a[1][3] * c0, -a[0][0] * c4 + a[0][1] * c2 - a[0][3] * c0,
+                           a[3][0] * s4 - a[3][1] * s2 + a[3][3] * s0, -a[2][0] * s4 + a[2][1] * s2 - a[2][3] * s0);
+    res[3] = Vec<4, float>(-a[1][0] * c3 + a[1][1] * c1 - a[1][2] * c0, a[0][0] * c3 - a[0][1] * c1 + a[0][2] * c0,
+                           -a[3][0] * s3 + a[3][1] * s1 - a[3][2] * s0, a[2][0] * s3 - a[2][1] * s1 + a[2][2] * s0);
+    return res;
+}
+
+inline float Matr<4, 4, float>::det() const {
+    float d;
+    adjugateTranspose(&d);
+    return d;
+}
+
+inline Vec<4, float> operator*(const Matr<4, 4, float> &m, const Vec<4, float> &v) {
+    __m128 r0 = _mm_mul_ps(m[0].v, v.v);
+    __m128 r1 = _mm_mul_ps(m[1].v, v.v);
+    __m128 r2 = _mm_mul_ps(m[2].v, v.v);
+    __m128 r3 = _mm_mul_ps(m[3].v, v.v);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    return Vec<4, float>(_mm_add_ps(_mm_add_ps(r0, r1), _mm_add_ps(r2, r3)));
+}
+
+inline Matr<4, 4, float> operator*(const Matr<4, 4, float> &a, const Matr<4, 4, float> &b) {
+    Matr<4, 4, float> res;
+    for (size_t i = 4; i--; ) {
+        __m128 row = _mm_mul_ps(_mm_set1_ps(a[i][0]), b[0].v);
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i][1]), b[1].v));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i][2]), b[2].v));
+        row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[i][3]), b[3].v));
+        res[i].v = row;
+    }
+    return res;
+}
+#endif
+
 
 template<size_t ROWS, size_t COLS, typename T>
 Vec<ROWS, T> operator*(const Matr<ROWS, COLS, T> &m, const Vec<COLS, T> &v) {
@@ -341,4 +554,139 @@ using Vec2f = Vec<2, float>;
 using Vec3i = Vec<3, int>;
 using Vec3f = Vec<3, float>;
 using Vec4f = Vec<4, float>;
-using Matrix = Matr<4, 4, float>;
\ No newline at end of file
+using Matrix = Matr<4, 4, float>;
+
+/* Lanes of floats processed together, FloatN is the widest type the target supports */
+#ifdef GEOMETRY_SSE
+class Float4 {
+public:
+    static const int WIDTH = 4;
+
+    Float4() {}
+    Float4(float f): v(_mm_set1_ps(f)) {}
+    explicit Float4(__m128 v): v(v) {}
+
+    static Float4 load(const float* p) { return Float4(_mm_loadu_ps(p)); }
+    /* Integers below 2^24 convert exactly */
+    static Float4 load(const uint16_t* p) {
+        return Float4(_mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128())));
+    }
+    static Float4 load(const uint32_t* p) { return Float4(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)p))); }
+    static Float4 ramp() { return Float4(_mm_setr_ps(0, 1, 2, 3)); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    /* One bit per lane of a comparison result */
+    int mask() const { return _mm_movemask_ps(v); }
+
+    __m128 v;
+};
+
+inline Float4 operator+(Float4 a, Float4 b) { return Float4(_mm_add_ps(a.v, b.v)); }
+inline Float4 operator-(Float4 a, Float4 b) { return Float4(_mm_sub_ps(a.v, b.v)); }
+inline Float4 operator*(Float4 a, Float4 b) { return Float4(_mm_mul_ps(a.v, b.v)); }
+inline Float4 operator/(Float4 a, Float4 b) { return Float4(_mm_div_ps(a.v, b.v)); }
+inline Float4 operator&(Float4 a, Float4 b) { return Float4(_mm_and_ps(a.v, b.v)); }
+inline Float4 operator<=(Float4 a, Float4 b) { return Float4(_mm_cmple_ps(a.v, b.v)); }
+inline Float4 operator>=(Float4 a, Float4 b) { return Float4(_mm_cmpge_ps(a.v, b.v)); }
+inline Float4 min(Float4 a, Float4 b) { return Float4(_mm_min_ps(a.v, b.v)); }
+inline Float4 max(Float4 a, Float4 b) { return Float4(_mm_max_ps(a.v, b.v)); }
+/* Rounds towards zero, for values that fit an int */
+inline Float4 trunc(Float4 a) { return Float4(_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v))); }
+#endif
+
+#ifdef __AVX__
+class Float8 {
+public:
+    static const int WIDTH = 8;
+
+    Float8() {}
+    Float8(float f): v(_mm256_set1_ps(f)) {}
+    explicit Float8(__m256 v): v(v) {}
+
+    static Float8 load(const float* p) { return Float8(_mm256_loadu_ps(p)); }
+    static Float8 load(const uint16_t* p) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p), zero = _mm_setzero_si128();
+        __m256i lanes = _mm256_insertf128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(v, zero)), _mm_unpackhi_epi16(v, zero), 1);
+        return Float8(_mm256_cvtepi32_ps(lanes));
+    }
+    static Float8 load(const uint32_t* p) { return Float8(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)p))); }
+    static Float8 ramp() { return Float8(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+    int mask() const { return _mm256_movemask_ps(v); }
+
+    __m256 v;
+};
+
+inline Float8 operator+(Float8 a, Float8 b) { return Float8(_mm256_add_ps(a.v, b.v)); }
+inline Float8 operator-(Float8 a, Float8 b) { return Float8(_mm256_sub_ps(a.v, b.v)); }
+inline Float8 operator*(Float8 a, Float8 b) { return Float8(_mm256_mul_ps(a.v, b.v)); }
+inline Float8 operator/(Float8 a, Float8 b) { return Float8(_mm256_div_ps(a.v, b.v)); }
+inline Float8 operator&(Float8 a, Float8 b) { return Float8(_mm256_and_ps(a.v, b.v)); }
+inline Float8 operator<=(Float8 a, Float8 b) { return Float8(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+inline Float8 operator>=(Float8 a, Float8 b) { return Float8(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)); }
+inline Float8 min(Float8 a, Float8 b) { return Float8(_mm256_min_ps(a.v, b.v)); }
+inline Float8 max(Float8 a, Float8 b) { return Float8(_mm256_max_ps(a.v, b.v)); }
+inline Float8 trunc(Float8 a) { return Float8(_mm256_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)); }
+#endif
+
+/* Scalar fallback with the same interface */
+class Float1 {
+public:
+    static const int WIDTH = 1;
+
+    Float1() {}
+    Float1(float f): v(f) {}
+
+    static Float1 load(const float* p) { return Float1(*p); }
+    static Float1 load(const uint16_t* p) { return Float1(*p); }
+    static Float1 load(const uint32_t* p) { return Float1(*p); }
+    static Float1 ramp() { return Float1(0); }
+    void store(float* p) const { *p = v; }
+    int mask() const { return v != 0; }
+
+    float v;
+};
+
+inline Float1 operator+(Float1 a, Float1 b) { return Float1(a.v + b.v); }
+inline Float1 operator-(Float1 a, Float1 b) { return Float1(a.v - b.v); }
+inline Float1 operator*(Float1 a, Float1 b) { return Float1(a.v * b.v); }
+inline Float1 operator/(Float1 a, Float1 b) { return Float1(a.v / b.v); }
+inline Float1 operator&(Float1 a, Float1 b) { return Float1(a.v != 0 && b.v != 0); }
+inline Float1 operator<=(Float1 a, Float1 b) { return Float1(a.v <= b.v); }
+inline Float1 operator>=(Float1 a, Float1 b) { return Float1(a.v >= b.v); }
+inline Float1 min(Float1 a, Float1 b) { return Float1(a.v < b.v ? a.v : b.v); }
+inline Float1 max(Float1 a, Float1 b) { return Float1(a.v > b.v ? a.v : b.v); }
+inline Float1 trunc(Float1 a) { return Float1(std::trunc(a.v)); }
+
+#if defined(__AVX__)
+using FloatN = Float8;
+#elif defined(GEOMETRY_SSE)
+using FloatN = Float4;
+#else
+using FloatN = Float1;
+#endif
+
+/* WIDTH three-component vectors stored as one lane type per component */
+template<typename F>
+class Vec3N {
+public:
+    Vec3N() {}
+    Vec3N(F x, F y, F z): x(x), y(y), z(z) {}
+    explicit Vec3N(const Vec3f &v): x(v.x), y(v.y), z(v.z) {}
+
+    F x, y, z;
+};
+
+template<typename F>
+Vec3N<F> operator+(const Vec3N<F> &a, const Vec3N<F> &b) {
+    return Vec3N<F>(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+template<typename F>
+Vec3N<F> operator*(const Vec3N<F> &a, F factor) {
+    return Vec3N<F>(a.x * factor, a.y * factor, a.z * factor);
+}
+
+template<typename F>
+F dot(const Vec3N<F> &a, const Vec3N<F> &b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
\ No newline at end of file
@@ -4,16 +4,11 @@
 
 #include "image.h"
 
-unsigned char* Image::data;
-size_t Image::width;
-size_t Image::height;
-size_t Image::bytespp;
-
 Image::Image() {
 }
 
+/* Decoding keeps no shared state so textures can be loaded from several threads */
 QImage Image::read_tga_file(const char *filename) {
-    data = NULL;
     std::ifstream in;
     in.open(filename, std::ios::binary);
     if (!in.is_open()) {
@@ -28,60 +23,58 @@ QImage Image::read_tga_file(const char *filename) {
         std::cerr << "an error occured while reading the header\n";
         return QImage();
     }
-    width = header.width;
-    height = header.height;
-    bytespp = header.bitsperpixel >> 3;
+    size_t width = header.width;
+    size_t height = header.height;
+    size_t bytespp = header.bitsperpixel >> 3;
     if (width <= 0 || height <= 0 || (bytespp != GRAYSCALE && bytespp != RGB && bytespp != RGBA)) {
         in.close();
         std::cerr << "bad bpp (or width/height) value\n";
         return QImage();
     }
     unsigned long nbytes = bytespp * width * height;
-    data = new unsigned char[nbytes];
+    unsigned char* data = new unsigned char[nbytes];
     if (header.datatypecode == 2 || header.datatypecode == 3) {
         in.read((char *)data, nbytes);
         if (!in.good()) {
             in.close();
+            delete[] data;
             std::cerr << "an error occured while reading the data\n";
             return QImage();
         }
     } else if (header.datatypecode == 10 || header.datatypecode == 11) {
-        if (!load_rle_data(in)) {
+        if (!load_rle_data(in, data, width, height, bytespp)) {
             in.close();
+            delete[] data;
             std::cerr << "an error occured while reading the data\n";
             return QImage();
         }
     } else {
         in.close();
+        delete[] data;
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return QImage();
     }
-    QImage res(width, height, QImage::Format_RGB32);
-    for (size_t x = 0; x < width; ++x) {
-        for (size_t y = 0; y < height; ++y) {
-            unsigned char bgra[4];
-            bgra[3] = 0;
-            memcpy(bgra, data + (x + y * width) * bytespp, bytespp);
-            if (bytespp == GRAYSCALE) {
-                bgra[2] = bgra[1] = bgra[0];
-            }
-            QRgb color = *(unsigned int*)bgra;
-            res.setPixel(x, y, color);
+    /* TGA rows go bottom up unless bit 5 is set and right to left if bit 4 is, rows are written straight to their place */
+    bool alpha = bytespp == RGBA && (header.imagedescriptor & 0x0f);
+    QImage res(width, height, alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    bool bottom_up = !(header.imagedescriptor & 0x20), right_to_left = header.imagedescriptor & 0x10;
+    for (size_t y = 0; y < height; ++y) {
+        QRgb* line = (QRgb*)res.scanLine(bottom_up ? height - 1 - y : y);
+        const unsigned char* src = data + y * width * bytespp;
+        for (size_t x = 0; x < width; ++x, src += bytespp) {
+            unsigned char b = src[0];
+            unsigned char g = bytespp == GRAYSCALE ? b : src[1];
+            unsigned char r = bytespp == GRAYSCALE ? b : src[2];
+            line[right_to_left ? width - 1 - x : x] = qRgba(r, g, b, alpha ? src[3] : 255);
         }
     }
-    if (!(header.imagedescriptor & 0x20)) {
-        res = res.mirrored();
-    }
-    if (header.imagedescriptor & 0x10) {
-        res = res.mirrored(true, false);
-    }
     std::cerr << filename << ": " << width << "x" << height << "/" << bytespp * 8 << "\n";
     in.close();
     delete[] data;
     return res;
 }
 
-bool Image::load_rle_data(std::ifstream &in) {
+bool Image::load_rle_data(std::ifstream &in, unsigned char* data, size_t width, size_t height, size_t bytespp) {
     unsigned long pixelcount = width * height;
     unsigned long currentpixel = 0;
     unsigned long currentbyte  = 0;
@@ -27,13 +27,8 @@ public:
     static QImage readFile(const char *filename);
 private:
     Image();
-    
-    static unsigned char* data;
-    static size_t width;
-    static size_t height;
-    static size_t bytespp;
 
-    static bool load_rle_data(std::ifstream &in);
+    static bool load_rle_data(std::ifstream &in, unsigned char* data, size_t width, size_t height, size_t bytespp);
     static QImage read_tga_file(const char *filename);
 
     enum Format {
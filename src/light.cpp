@@ -0,0 +1,96 @@
+#include <algorithm>
+
+#include "light.h"
+
+Light Light::directional(const Vec3f &dir, const Vec3f &color, bool cast_shadows) {
+    Light res;
+    res.type = DIRECTIONAL;
+    res.vec = dir;
+    res.vec.normalize();
+    res.color = color;
+    res.radius = 0;
+    res.cast_shadows = cast_shadows;
+    return res;
+}
+
+Light Light::point(const Vec3f &pos, float radius, const Vec3f &color, bool cast_shadows) {
+    Light res;
+    res.type = POINT;
+    res.vec = pos;
+    res.color = color;
+    res.radius = radius;
+    res.cast_shadows = cast_shadows;
+    return res;
+}
+
+bool Light::screenBounds(const Matrix &mvp, int width, int height, Vec2i &bbmin, Vec2i &bbmax) const {
+    bbmin = Vec2i(0, 0);
+    bbmax = Vec2i(width - 1, height - 1);
+    if (color.x <= 0 && color.y <= 0 && color.z <= 0) {
+        return false;
+    }
+    if (type == DIRECTIONAL) {
+        return true;
+    }
+    /* Project the corners of the bounding box of the light sphere */
+    Vec2f lo(width, height), hi(-1, -1);
+    for (int i = 0; i < 8; ++i) {
+        Vec3f corner(vec.x + (i & 1 ? radius : -radius),
+                     vec.y + (i & 2 ? radius : -radius),
+                     vec.z + (i & 4 ? radius : -radius));
+        Vec4f p = mvp * embed<4>(corner);
+        if (p[3] < 1e-3) {
+            /* Sphere crosses the eye plane */
+            return true;
+        }
+        for (size_t j = 0; j < 2; ++j) {
+            lo[j] = std::min(lo[j], p[j] / p[3]);
+            hi[j] = std::max(hi[j], p[j] / p[3]);
+        }
+    }
+    bbmin = Vec2i(std::max(0, (int)std::floor(lo.x)), std::max(0, (int)std::floor(lo.y)));
+    bbmax = Vec2i(std::min(width - 1, (int)std::ceil(hi.x)), std::min(height - 1, (int)std::ceil(hi.y)));
+    return bbmin.x <= bbmax.x && bbmin.y <= bbmax.y;
+}
+
+LightGrid::LightGrid(): cols(0), rows(0), offsets(NULL), indices(NULL) {}
+
+void LightGrid::build(const QVector<Light> &lights, const Matrix &mvp, int width, int height, gl::Arena &arena) {
+    cols = (width + TILE_SIZE - 1) / TILE_SIZE;
+    rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    Vec2i* tmin = arena.alloc<Vec2i>(lights.size());
+    Vec2i* tmax = arena.alloc<Vec2i>(lights.size());
+    bool* visible = arena.alloc<bool>(lights.size());
+    offsets = arena.alloc<int>(cols * rows + 1);
+    std::fill(offsets, offsets + cols * rows + 1, 0);
+    for (int k = 0; k < lights.size(); ++k) {
+        Vec2i bbmin, bbmax;
+        visible[k] = lights[k].screenBounds(mvp, width, height, bbmin, bbmax);
+        if (!visible[k]) {
+            continue;
+        }
+        tmin[k] = Vec2i(bbmin.x / TILE_SIZE, bbmin.y / TILE_SIZE);
+        tmax[k] = Vec2i(bbmax.x / TILE_SIZE, bbmax.y / TILE_SIZE);
+        for (int ty = tmin[k].y; ty <= tmax[k].y; ++ty) {
+            for (int tx = tmin[k].x; tx <= tmax[k].x; ++tx) {
+                offsets[ty * cols + tx + 1]++;
+            }
+        }
+    }
+    for (int t = 0; t < cols * rows; ++t) {
+        offsets[t + 1] += offsets[t];
+    }
+    indices = arena.alloc<int>(offsets[cols * rows]);
+    int* fill = arena.alloc<int>(cols * rows);
+    std::copy(offsets, offsets + cols * rows, fill);
+    for (int k = 0; k < lights.size(); ++k) {
+        if (!visible[k]) {
+            continue;
+        }
+        for (int ty = tmin[k].y; ty <= tmax[k].y; ++ty) {
+            for (int tx = tmin[k].x; tx <= tmax[k].x; ++tx) {
+                indices[fill[ty * cols + tx]++] = k;
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QVector>
+
+#include "geometry.h"
+#include "arena.h"
+#include "framebuffer.h"
+
+class Light {
+public:
+    enum Type {
+        DIRECTIONAL, POINT
+    };
+
+    static Light directional(const Vec3f &dir, const Vec3f &color = Vec3f(1, 1, 1), bool cast_shadows = true);
+    static Light point(const Vec3f &pos, float radius, const Vec3f &color = Vec3f(1, 1, 1), bool cast_shadows = false);
+
+    /* Screen-space rectangle the light can affect, clamped to the frame */
+    bool screenBounds(const Matrix &mvp, int width, int height, Vec2i &bbmin, Vec2i &bbmax) const;
+
+    Type type;
+    /* Direction towards the light for DIRECTIONAL, position for POINT */
+    Vec3f vec;
+    Vec3f color;
+    float radius;
+    bool cast_shadows;
+    gl::DepthBuffer shadowbuffer;
+    Matrix shadow_m;
+};
+
+/*
+ * Per-tile light lists stored in CSR form: lights of tile t are indices[offsets[t]..offsets[t + 1]).
+ * The lists live in the arena given to build() and are valid until it is reset.
+ */
+class LightGrid {
+public:
+    static const int TILE_SIZE = 16;
+
+    LightGrid();
+    void build(const QVector<Light> &lights, const Matrix &mvp, int width, int height, gl::Arena &arena);
+
+    int tile(int x, int y) const {
+        return (y / TILE_SIZE) * cols + x / TILE_SIZE;
+    }
+
+    int count(int tile) const {
+        return offsets[tile + 1] - offsets[tile];
+    }
+
+    const int* lights(int tile) const {
+        return indices + offsets[tile];
+    }
+private:
+    int cols, rows;
+    int* offsets;
+    int* indices;
+};
\ No newline at end of file
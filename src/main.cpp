@@ -1,13 +1,86 @@
 #include <QApplication>
+#include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QDebug>
+#include <QThread>
 
+#include <algorithm>
 #include <iostream>
 
 #include "mainwindow.h"
+#include "options.h"
+#include "renderer.h"
+#include "framewriter.h"
+#include "renderserver.h"
+#include "stats.h"
+
+/* Renders a turntable without a window, frames are written while the next batch of views renders */
+static int renderBatch(const Options &options) {
+    Scene scene;
+    if (!options.setup(&scene)) {
+        return 1;
+    }
+    scene.waitForAssets();
+    Renderer renderer(&scene, options.size.width(), options.size.height());
+    if (!renderer.setSamples(options.samples) || !renderer.setShadowDepth(options.shadow_depth)) {
+        return 1;
+    }
+    renderer.setLodThreshold(options.lod_error);
+    renderer.setAmbientOcclusion(options.ssao);
+
+    FrameWriter writer(options.output, options.fps);
+    QElapsedTimer timer;
+    timer.start();
+    /* Views of a batch share the shadow maps and render in parallel, batches are kept small to bound memory */
+    int batch = std::max(1, QThread::idealThreadCount());
+    Camera camera = renderer.camera();
+    for (int i = 0; i < options.frames; i += batch) {
+        QVector<Camera> cameras;
+        for (int j = i; j < std::min(options.frames, i + batch); ++j) {
+            cameras.push_back(camera.orbit(360.0f * j / options.frames));
+        }
+        if (!writer.write(renderer.renderViews(cameras))) {
+            return 1;
+        }
+    }
+    if (!writer.close()) {
+        return 1;
+    }
+    std::cerr << "Wrote " << writer.frames() << " frames to " << options.output.toStdString() << " in "
+              << timer.elapsed() << " ms\n";
+    if (!options.trace.isEmpty() && gl::Stats::enabled()) {
+        gl::stats.writeTrace(options.trace);
+    }
+    return 0;
+}
 
 int main(int argc, char** argv) {
+    QStringList arguments;
+    for (int i = 0; i < argc; ++i) {
+        arguments.push_back(QString::fromLocal8Bit(argv[i]));
+    }
+    Options options;
+    int status;
+    if (!options.parse(arguments, status)) {
+        return status;
+    }
+    if (!options.output.isEmpty()) {
+        QCoreApplication app(argc, argv);
+        return renderBatch(options);
+    }
+    if (!options.serve.isEmpty()) {
+        QCoreApplication app(argc, argv);
+        RenderServer server(options.workers, options.cache_budget * qint64(1024 * 1024));
+        if (!server.listen(options.serve)) {
+            return 1;
+        }
+        return app.exec();
+    }
     QApplication app(argc, argv);
-    MainWindow window;
+    MainWindow window(options);
+    if (!window.isReady()) {
+        return 1;
+    }
     window.show();
     return app.exec();
 }
\ No newline at end of file
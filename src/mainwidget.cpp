@@ -1,4 +1,3 @@
-#include <QCoreApplication>
 #include <QString>
 #include <QChar>
 #include <QPoint>
@@ -9,9 +8,12 @@
 #include <QImage>
 #include <QDebug>
 
+#include <iostream>
+
 #include "mainwidget.h"
+#include "stats.h"
 
-MainWidget::MainWidget(MainWindow* parent): parent(parent) {
+MainWidget::MainWidget(const Options &options, MainWindow* parent): parent(parent), show_stats(false) {
     QSignalMapper* mapper = new QSignalMapper(this);
     
     QPushButton* arrows[4];
@@ -36,17 +38,21 @@ MainWidget::MainWidget(MainWindow* parent): parent(parent) {
     layout->addLayout(arrows_layout);
     setLayout(layout);
 
-    QVector<QString> models;
-    QStringList args = QCoreApplication::arguments();
-    if (args.size() == 1) {
-        models.push_back("models/african_head/african_head.obj");
-        models.push_back("models/african_head/african_head_eye_inner.obj");
-    } else {
-        for (int i = 1; i < args.size(); ++i) {
-            models.push_back(args.at(i));
-        }
+    scene = new Scene(this);
+    connect(scene, SIGNAL(assetLoaded(int)), this, SLOT(update()));
+    ready = options.setup(scene);
+    renderer = new Renderer(scene, parent->width(), parent->height(), this);
+    renderer->setSamples(options.samples);
+    renderer->setShadowDepth(options.shadow_depth);
+    renderer->setLodThreshold(options.lod_error);
+    renderer->setAmbientOcclusion(options.ssao);
+    connect(renderer, SIGNAL(changed()), this, SLOT(update()));
+
+    show_stats = options.stats;
+    trace_file = options.trace;
+    if ((show_stats || !trace_file.isEmpty()) && !gl::Stats::enabled()) {
+        std::cerr << "built without RENDERER_STATS, only stage timings are available\n";
     }
-    renderer = new Renderer(models, parent->width(), parent->height(), this);
     connect(mapper, SIGNAL(mapped(QObject*)), renderer, SLOT(moveLight(QObject*)));
 }
 
@@ -54,7 +60,21 @@ void MainWidget::paintEvent(QPaintEvent *event) {
     QImage image = renderer->genFrame();
     if (!image.isNull()) {
         QPainter painter(this);
-        painter.drawImage(QPoint(0, 0), image.mirrored());
+        painter.drawImage(QPoint(0, 0), image);
+        if (show_stats) {
+            const Renderer::Timings &t = renderer->lastTimings();
+            QString text = QString("vertex %1 ms, shadow %2 ms, shading %3 ms, occlusion %4 ms\n").arg(t.vertex / 1e6, 0, 'f', 2)
+                    .arg(t.shadow / 1e6, 0, 'f', 2).arg(t.shading / 1e6, 0, 'f', 2).arg(t.occlusion / 1e6, 0, 'f', 2)
+                    + gl::stats.summary();
+            painter.setPen(Qt::yellow);
+            painter.drawText(rect().adjusted(8, 8, -8, -8), Qt::AlignBottom | Qt::AlignLeft, text);
+        }
+    }
+}
+
+MainWidget::~MainWidget() {
+    if (!trace_file.isEmpty() && gl::Stats::enabled()) {
+        gl::stats.writeTrace(trace_file);
     }
 }
 
@@ -71,4 +91,8 @@ void MainWidget::keyPress(QKeyEvent *event) const {
             renderer->moveCenter(QPoint(dx[i], dy[i]));
         }
     }
+}
+
+bool MainWidget::isReady() const {
+    return ready;
 }
\ No newline at end of file
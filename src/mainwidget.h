@@ -4,21 +4,31 @@
 #include <QVBoxLayout>
 #include <QPushButton>
 #include <QPaintEvent>
+#include <QString>
 
 #include "mainwindow.h"
 #include "renderer.h"
+#include "scene.h"
+#include "options.h"
 
 class MainWindow;
 
 class MainWidget: public QWidget {
     Q_OBJECT
 public:
-    MainWidget(MainWindow* parent = 0);
+    MainWidget(const Options &options, MainWindow* parent = 0);
+    ~MainWidget();
     void keyPress(QKeyEvent *event) const;
+    bool isReady() const;
 protected:
     void paintEvent(QPaintEvent *event);
 private:
+    Scene* scene;
     Renderer* renderer;
     MainWindow* parent;
     QVBoxLayout* layout;
+    /* The scene and models given on the command line could be read */
+    bool ready;
+    bool show_stats;
+    QString trace_file;
 };
\ No newline at end of file
@@ -1,15 +1,16 @@
 #include "mainwindow.h"
 
-#define WIDTH 1000
-#define HEIGHT 700
-
-MainWindow::MainWindow() {
-    this->setFixedSize(WIDTH, HEIGHT);
+MainWindow::MainWindow(const Options &options) {
+    this->setFixedSize(options.size);
     this->setWindowTitle("Qt Renderer");
-    mainWidget = new MainWidget(this);
+    mainWidget = new MainWidget(options, this);
     this->setCentralWidget(mainWidget);
 }
 
+bool MainWindow::isReady() const {
+    return mainWidget->isReady();
+}
+
 void MainWindow::keyPressEvent(QKeyEvent *event) {
 	mainWidget->keyPress(event);
 }
\ No newline at end of file
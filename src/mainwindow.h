@@ -3,13 +3,16 @@
 #include <QMainWindow>
 
 #include "mainwidget.h"
+#include "options.h"
 
 class MainWidget;
 
 class MainWindow: public QMainWindow {
     Q_OBJECT
 public:
-    MainWindow();
+    MainWindow(const Options &options);
+    /* False when the scene could not be set up, the window should not be shown */
+    bool isReady() const;
     void keyPressEvent(QKeyEvent *event);
 private:
 	MainWidget* mainWidget;
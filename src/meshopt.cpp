@@ -0,0 +1,397 @@
+#include <cmath>
+#include <queue>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+#include "meshopt.h"
+
+namespace {
+    /* Symmetric 4x4 error quadric of the squared distance to a set of planes */
+    class Quadric {
+    public:
+        Quadric() {
+            std::fill(q, q + 10, 0.0);
+        }
+
+        Quadric(const Vec3f &n, float d, double weight) {
+            double a = n.x, b = n.y, c = n.z;
+            q[0] = a * a; q[1] = a * b; q[2] = a * c; q[3] = a * d;
+            q[4] = b * b; q[5] = b * c; q[6] = b * d;
+            q[7] = c * c; q[8] = c * d;
+            q[9] = (double)d * d;
+            for (size_t i = 0; i < 10; ++i) {
+                q[i] *= weight;
+            }
+        }
+
+        Quadric& operator+=(const Quadric &o) {
+            for (size_t i = 0; i < 10; ++i) {
+                q[i] += o.q[i];
+            }
+            return *this;
+        }
+
+        double error(const Vec3f &p) const {
+            double x = p.x, y = p.y, z = p.z;
+            return x * x * q[0] + 2 * x * y * q[1] + 2 * x * z * q[2] + 2 * x * q[3]
+                + y * y * q[4] + 2 * y * z * q[5] + 2 * y * q[6]
+                + z * z * q[7] + 2 * z * q[8] + q[9];
+        }
+    private:
+        double q[10];
+    };
+
+    class Collapse {
+    public:
+        double cost;
+        int from, to;
+        int from_version, to_version;
+
+        bool operator<(const Collapse &o) const {
+            return cost > o.cost;
+        }
+    };
+
+    Vec3f faceNormal(const QVector<Vec3f> &verts, int a, int b, int c) {
+        return (verts[b] - verts[a]) ^ (verts[c] - verts[a]);
+    }
+
+    const int FORSYTH_CACHE_SIZE = 32;
+
+    float vertexScore(int cache_pos, int valence) {
+        if (valence == 0) {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cache_pos >= 3) {
+            /* The last triangle's vertices get a fixed score so the next one does not just reuse its edge */
+            score = std::pow(1.0f - (cache_pos - 3) / float(FORSYTH_CACHE_SIZE - 3), 1.5f);
+        } else if (cache_pos >= 0) {
+            score = 0.75f;
+        }
+        /* Vertices with few remaining triangles are finished off first */
+        return score + 2.0f / std::sqrt((float)valence);
+    }
+}
+
+float meshopt::simplify(const QVector<Vec3f> &verts, const Faces &in, int target, Faces &out) {
+    const int nverts = verts.size();
+    const int nfaces = in.size();
+    Faces faces = in;
+    std::vector<bool> face_alive(nfaces, true);
+    std::vector<bool> vert_alive(nverts, true);
+    std::vector<bool> locked(nverts, false);
+    std::vector<int> version(nverts, 0);
+    std::vector<int> vt_of(nverts, -1), vn_of(nverts, -1);
+    std::vector<std::vector<int> > vert_faces(nverts);
+    std::vector<Quadric> quadrics(nverts);
+
+    for (int f = 0; f < nfaces; ++f) {
+        Vec3f n = faceNormal(verts, faces.v[3 * f], faces.v[3 * f + 1], faces.v[3 * f + 2]);
+        if (n.len() > 0) {
+            n.normalize();
+        }
+        /* Unweighted planes keep the error in units of squared distance */
+        Quadric plane(n, -(n * verts[faces.v[3 * f]]), 1.0);
+        for (size_t j = 0; j < 3; ++j) {
+            int v = faces.v[3 * f + j];
+            vert_faces[v].push_back(f);
+            quadrics[v] += plane;
+            /* A position used with several texture coordinates or normals lies on a seam */
+            if (vt_of[v] < 0) {
+                vt_of[v] = faces.vt[3 * f + j];
+                vn_of[v] = faces.vn[3 * f + j];
+            } else if (vt_of[v] != faces.vt[3 * f + j] || vn_of[v] != faces.vn[3 * f + j]) {
+                locked[v] = true;
+            }
+        }
+    }
+    /* Border and non-manifold edges are not shared by exactly two faces */
+    std::vector<std::pair<int, int> > edges;
+    edges.reserve(3 * nfaces);
+    for (int f = 0; f < nfaces; ++f) {
+        for (size_t j = 0; j < 3; ++j) {
+            int a = faces.v[3 * f + j], b = faces.v[3 * f + (j + 1) % 3];
+            edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size(); ) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i]) {
+            ++j;
+        }
+        if (j - i != 2) {
+            locked[edges[i].first] = locked[edges[i].second] = true;
+        }
+        i = j;
+    }
+
+    std::priority_queue<Collapse> heap;
+    std::vector<int> ring;
+    /* Neighbours of v over its live faces */
+    auto neighbours = [&](int v, std::vector<int> &res) {
+        res.clear();
+        for (size_t k = 0; k < vert_faces[v].size(); ++k) {
+            int f = vert_faces[v][k];
+            if (!face_alive[f]) {
+                continue;
+            }
+            for (size_t j = 0; j < 3; ++j) {
+                if (faces.v[3 * f + j] != v) {
+                    res.push_back(faces.v[3 * f + j]);
+                }
+            }
+        }
+        std::sort(res.begin(), res.end());
+        res.erase(std::unique(res.begin(), res.end()), res.end());
+    };
+    auto push = [&](int from, int to) {
+        if (locked[from]) {
+            return;
+        }
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        Collapse c = {std::max(0.0, q.error(verts[to])), from, to, version[from], version[to]};
+        heap.push(c);
+    };
+    for (int v = 0; v < nverts; ++v) {
+        neighbours(v, ring);
+        for (size_t k = 0; k < ring.size(); ++k) {
+            push(v, ring[k]);
+        }
+    }
+
+    int alive = nfaces;
+    double max_error = 0;
+    std::vector<int> ring_to;
+    while (alive > target && !heap.empty()) {
+        Collapse c = heap.top();
+        heap.pop();
+        int u = c.from, v = c.to;
+        if (!vert_alive[u] || !vert_alive[v] || version[u] != c.from_version || version[v] != c.to_version) {
+            continue;
+        }
+        /* Link condition: an interior edge may share only the two opposite vertices */
+        neighbours(u, ring);
+        neighbours(v, ring_to);
+        std::vector<int> common;
+        std::set_intersection(ring.begin(), ring.end(), ring_to.begin(), ring_to.end(), std::back_inserter(common));
+        if (common.size() != 2) {
+            continue;
+        }
+        /* Reject collapses that flip or degenerate a remaining face, and pick up v's attributes */
+        bool valid = true;
+        int vt = -1, vn = -1;
+        for (size_t k = 0; k < vert_faces[u].size() && valid; ++k) {
+            int f = vert_faces[u][k];
+            if (!face_alive[f]) {
+                continue;
+            }
+            int corners[3] = {faces.v[3 * f], faces.v[3 * f + 1], faces.v[3 * f + 2]};
+            bool has_v = false;
+            for (size_t j = 0; j < 3; ++j) {
+                if (corners[j] == v) {
+                    has_v = true;
+                    vt = faces.vt[3 * f + j];
+                    vn = faces.vn[3 * f + j];
+                }
+            }
+            if (has_v) {
+                continue;
+            }
+            Vec3f before = faceNormal(verts, corners[0], corners[1], corners[2]);
+            for (size_t j = 0; j < 3; ++j) {
+                corners[j] = corners[j] == u ? v : corners[j];
+            }
+            Vec3f after = faceNormal(verts, corners[0], corners[1], corners[2]);
+            valid = after * before > 0.2f * before.len() * after.len();
+        }
+        if (!valid || vt < 0) {
+            continue;
+        }
+
+        for (size_t k = 0; k < vert_faces[u].size(); ++k) {
+            int f = vert_faces[u][k];
+            if (!face_alive[f]) {
+                continue;
+            }
+            bool has_v = faces.v[3 * f] == v || faces.v[3 * f + 1] == v || faces.v[3 * f + 2] == v;
+            if (has_v) {
+                face_alive[f] = false;
+                alive--;
+                continue;
+            }
+            for (size_t j = 0; j < 3; ++j) {
+                if (faces.v[3 * f + j] == u) {
+                    faces.v[3 * f + j] = v;
+                    faces.vt[3 * f + j] = vt;
+                    faces.vn[3 * f + j] = vn;
+                }
+            }
+            vert_faces[v].push_back(f);
+        }
+        vert_alive[u] = false;
+        quadrics[v] += quadrics[u];
+        version[v]++;
+        max_error = std::max(max_error, c.cost);
+
+        /* Only the edges around v changed cost, their old heap entries are stale now */
+        neighbours(v, ring);
+        for (size_t k = 0; k < ring.size(); ++k) {
+            push(v, ring[k]);
+            push(ring[k], v);
+        }
+    }
+
+    out = Faces();
+    out.v.reserve(3 * alive);
+    out.vt.reserve(3 * alive);
+    out.vn.reserve(3 * alive);
+    for (int f = 0; f < nfaces; ++f) {
+        if (!face_alive[f]) {
+            continue;
+        }
+        for (size_t j = 0; j < 3; ++j) {
+            out.v.push_back(faces.v[3 * f + j]);
+            out.vt.push_back(faces.vt[3 * f + j]);
+            out.vn.push_back(faces.vn[3 * f + j]);
+        }
+    }
+    return std::sqrt(max_error);
+}
+
+void meshopt::optimizeVertexCache(Faces &faces, int nverts) {
+    const int nfaces = faces.size();
+    std::vector<int> valence(nverts, 0), first(nverts + 1, 0), adjacency(3 * nfaces);
+    for (int i = 0; i < 3 * nfaces; ++i) {
+        valence[faces.v[i]]++;
+    }
+    for (int v = 0; v < nverts; ++v) {
+        first[v + 1] = first[v] + valence[v];
+    }
+    std::vector<int> fill(first.begin(), first.end() - 1);
+    for (int f = 0; f < nfaces; ++f) {
+        for (size_t j = 0; j < 3; ++j) {
+            adjacency[fill[faces.v[3 * f + j]]++] = f;
+        }
+    }
+
+    std::vector<float> vert_score(nverts), face_score(nfaces, 0.0f);
+    std::vector<bool> emitted(nfaces, false);
+    for (int v = 0; v < nverts; ++v) {
+        vert_score[v] = vertexScore(-1, valence[v]);
+    }
+    for (int f = 0; f < nfaces; ++f) {
+        for (size_t j = 0; j < 3; ++j) {
+            face_score[f] += vert_score[faces.v[3 * f + j]];
+        }
+    }
+
+    std::vector<int> cache, next_cache;
+    std::vector<int> order;
+    order.reserve(nfaces);
+    int best = nfaces ? 0 : -1;
+    for (int f = 1; f < nfaces; ++f) {
+        if (face_score[f] > face_score[best]) {
+            best = f;
+        }
+    }
+    int scan = 0;
+    while (best >= 0) {
+        emitted[best] = true;
+        order.push_back(best);
+        /* Move the triangle's vertices to the front of the LRU cache and drop them from the remaining valences */
+        next_cache.clear();
+        for (size_t j = 0; j < 3; ++j) {
+            int v = faces.v[3 * best + j];
+            next_cache.push_back(v);
+            for (int k = first[v]; k < first[v] + valence[v]; ++k) {
+                if (adjacency[k] == best) {
+                    std::swap(adjacency[k], adjacency[first[v] + valence[v] - 1]);
+                    break;
+                }
+            }
+            valence[v]--;
+        }
+        for (size_t k = 0; k < cache.size(); ++k) {
+            if (std::find(next_cache.begin(), next_cache.begin() + 3, cache[k]) == next_cache.begin() + 3) {
+                next_cache.push_back(cache[k]);
+            }
+        }
+        for (size_t k = FORSYTH_CACHE_SIZE; k < next_cache.size(); ++k) {
+            vert_score[next_cache[k]] = vertexScore(-1, valence[next_cache[k]]);
+        }
+        next_cache.resize(std::min<size_t>(next_cache.size(), FORSYTH_CACHE_SIZE));
+        cache.swap(next_cache);
+        for (size_t k = 0; k < cache.size(); ++k) {
+            vert_score[cache[k]] = vertexScore(k, valence[cache[k]]);
+        }
+        /* Only triangles around cached vertices changed score */
+        best = -1;
+        float best_score = -1.0f;
+        for (size_t k = 0; k < cache.size(); ++k) {
+            int v = cache[k];
+            for (int a = first[v]; a < first[v] + valence[v]; ++a) {
+                int f = adjacency[a];
+                face_score[f] = vert_score[faces.v[3 * f]] + vert_score[faces.v[3 * f + 1]] + vert_score[faces.v[3 * f + 2]];
+                if (face_score[f] > best_score) {
+                    best_score = face_score[f];
+                    best = f;
+                }
+            }
+        }
+        if (best < 0) {
+            /* Cache neighbourhood exhausted, continue with the next triangle in the original order */
+            while (scan < nfaces && emitted[scan]) {
+                ++scan;
+            }
+            best = scan < nfaces ? scan : -1;
+        }
+    }
+
+    Faces res;
+    res.v.reserve(3 * nfaces);
+    res.vt.reserve(3 * nfaces);
+    res.vn.reserve(3 * nfaces);
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            res.v.push_back(faces.v[3 * order[i] + j]);
+            res.vt.push_back(faces.vt[3 * order[i] + j]);
+            res.vn.push_back(faces.vn[3 * order[i] + j]);
+        }
+    }
+    faces = res;
+}
+
+QVector<int> meshopt::fetchRemap(const QVector<int> &indices, int nverts) {
+    QVector<int> remap(nverts, -1);
+    int next = 0;
+    for (int i = 0; i < indices.size(); ++i) {
+        if (remap[indices[i]] < 0) {
+            remap[indices[i]] = next++;
+        }
+    }
+    for (int v = 0; v < nverts; ++v) {
+        if (remap[v] < 0) {
+            remap[v] = next++;
+        }
+    }
+    return remap;
+}
+
+float meshopt::acmr(const QVector<int> &indices, int nverts, int cache_size) {
+    if (indices.isEmpty()) {
+        return 0;
+    }
+    /* A vertex is still cached if it entered the FIFO less than cache_size misses ago */
+    std::vector<int> stamp(nverts, -cache_size - 1);
+    int misses = 0;
+    for (int i = 0; i < indices.size(); ++i) {
+        if (misses - stamp[indices[i]] > cache_size) {
+            stamp[indices[i]] = misses++;
+        }
+    }
+    return misses / (indices.size() / 3.0f);
+}
\ No newline at end of file
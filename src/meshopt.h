@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QVector>
+
+#include "geometry.h"
+
+namespace meshopt {
+    /* Triangle corners indexing positions, texture coordinates and normals separately, as in wavefront obj */
+    class Faces {
+    public:
+        QVector<int> v, vt, vn;
+
+        int size() const {
+            return v.size() / 3;
+        }
+    };
+
+    /*
+     * Quadric error edge collapse down to about target triangles.
+     * Vertices on mesh borders and texture or normal seams are kept in place.
+     * Returns the largest estimated distance between the input and the result.
+     */
+    float simplify(const QVector<Vec3f> &verts, const Faces &in, int target, Faces &out);
+
+    /* Reorders triangles for post-transform vertex cache reuse (Forsyth's linear-speed algorithm) */
+    void optimizeVertexCache(Faces &faces, int nverts);
+
+    /* Maps old vertex indices to new ones in order of first use, unused vertices go last */
+    QVector<int> fetchRemap(const QVector<int> &indices, int nverts);
+
+    /* Average vertex transforms per triangle for a FIFO cache, from 0.5 (ideal) to 3 */
+    float acmr(const QVector<int> &indices, int nverts, int cache_size = 16);
+}
\ No newline at end of file
@@ -3,33 +3,94 @@
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
+#include <cctype>
+#include <iterator>
 #include <cassert>
+#include <algorithm>
+
+#include <QElapsedTimer>
+#include <QFileInfo>
 
 #include "image.h"
 #include "model.h"
 
-Model::Model(const std::string &filename) {
+Model::LoadTimings::LoadTimings(): textures(0), parse(0), prepare(0) {}
+
+Material Model::textureFiles(const std::string &filename, const Material &material) {
     std::string file = filename.substr(0, filename.find_last_of("."));
-    diffuse = Image::readFile((file + "_diffuse.tga").c_str());
-    normal_map = Image::readFile((file + "_nm.tga").c_str());
-    spec = Image::readFile((file + "_spec.tga").c_str());
-    std::ifstream in(filename);
+    Material res;
+    res.diffuse = material.diffuse.empty() ? file + "_diffuse.tga" : material.diffuse;
+    res.normal_map = material.normal_map.empty() ? file + "_nm.tga" : material.normal_map;
+    res.specular = material.specular.empty() ? file + "_spec.tga" : material.specular;
+    res.glow = material.glow.empty() ? file + "_glow.tga" : material.glow;
+    return res;
+}
+
+Model::Model(const std::string &filename, const Material &material): bound_radius(0), has_alpha(false) {
+    QElapsedTimer timer;
+    timer.start();
+    Material files = textureFiles(filename, material);
+    diffuse = Image::readFile(files.diffuse.c_str());
+    normal_map = Image::readFile(files.normal_map.c_str());
+    spec = Image::readFile(files.specular.c_str());
+    if (QFileInfo(QString::fromStdString(files.glow)).exists()) {
+        glow_map = Image::readFile(files.glow.c_str());
+    }
+    if (diffuse.hasAlphaChannel()) {
+        for (int y = 0; y < diffuse.height() && !has_alpha; ++y) {
+            const QRgb* line = (const QRgb*)diffuse.constScanLine(y);
+            for (int x = 0; x < diffuse.width() && !has_alpha; ++x) {
+                has_alpha = qAlpha(line[x]) < 255;
+            }
+        }
+    }
+    load_timings.textures = timer.nsecsElapsed();
+    std::ifstream in(filename.c_str(), std::ios::binary);
     if (in.fail()) {
         std::cerr << "Cannot read file " << filename << std::endl;
+        buildLods();
         return;
     }
-    std::string line;
-    while (std::getline(in, line)) {
-        std::istringstream iss(line.c_str());
-        std::string trash;
-        if (line.substr(0, 2) == "v ") {
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    /* Counting the records first lets every array be allocated once */
+    int nv = 0, nvt = 0, nvn = 0, nf = 0;
+    for (size_t pos = 0; pos < data.size(); ) {
+        const char* p = data.c_str() + pos;
+        if (p[0] == 'v') {
+            nv += p[1] == ' ';
+            nvt += p[1] == 't' && p[2] == ' ';
+            nvn += p[1] == 'n' && p[2] == ' ';
+        } else if (p[0] == 'f' && p[1] == ' ') {
+            ++nf;
+        }
+        size_t eol = data.find('\n', pos);
+        pos = eol == std::string::npos ? data.size() : eol + 1;
+    }
+    verts.reserve(nv);
+    uvs.reserve(nvt + 1);
+    norms.reserve(nvn + 1);
+    faces.v.reserve(3 * nf);
+    faces.vt.reserve(3 * nf);
+    faces.vn.reserve(3 * nf);
+
+    std::istringstream iss;
+    std::string line, trash;
+    bool missing_vt = false, missing_vn = false;
+    for (size_t pos = 0; pos < data.size(); ) {
+        size_t eol = std::min(data.find('\n', pos), data.size());
+        line.assign(data, pos, eol - pos);
+        pos = eol + 1;
+        iss.clear();
+        iss.str(line);
+        if (line.compare(0, 2, "v ") == 0) {
             iss >> trash;
             Vec3f v;
             for (int i = 0; i < 3; ++i) {
                 iss >> v[i];
             }
             verts.push_back(v);
-        } else if (line.substr(0, 3) == "vn ") {
+        } else if (line.compare(0, 3, "vn ") == 0) {
             iss >> trash;
             Vec3f vn;
             for (int i = 0; i < 3; ++i) {
@@ -37,42 +98,178 @@ Model::Model(const std::string &filename) {
             }
             vn.normalize();
             norms.push_back(vn);
-        } else if (line.substr(0, 3) == "vt ") {
+        } else if (line.compare(0, 3, "vt ") == 0) {
             iss >> trash;
             Vec2f vt;
             for (int i = 0; i < 2; ++i) {
                 iss >> vt[i];
             }
             uvs.push_back(vt);
-        } else if (line.substr(0, 2) == "f ") {
-            QVector<int> vs, vts, vns;
-            int idx;
-            iss >> trash;
-            std::string fdesc;
-            while (iss >> fdesc) {
-                size_t pos1 = fdesc.find('/');
-                idx = atoi(fdesc.substr(0, pos1).c_str());
-                idx--; // in wavefront obj all indices start at 1, not zero
-                vs.push_back(idx);
-                size_t pos2 = fdesc.find('/', pos1 + 1);
-                idx = atoi(fdesc.substr(pos1 + 1, pos2 - pos1 - 1).c_str());
-                if (idx) {
-                    idx--;
-                    vts.push_back(idx);
+        } else if (line.compare(0, 2, "f ") == 0) {
+            /* Corners are v/vt/vn with vt and vn optional, polygons become a fan of triangles */
+            int first = faces.v.size(), corners = 0;
+            const char* p = line.c_str() + 2;
+            while (true) {
+                while (*p && isspace(*p)) {
+                    ++p;
+                }
+                if (!*p) {
+                    break;
                 }
-                size_t pos3 = fdesc.find('/', pos2 + 1);
-                idx = atoi(fdesc.substr(pos2 + 1, pos3 - pos2 - 1).c_str());
-                if (idx) {
-                    idx--;
-                    vns.push_back(idx);
+                int idx[3] = {0, 0, 0};
+                for (int i = 0; i < 3; ++i) {
+                    char* end;
+                    idx[i] = strtol(p, &end, 10);
+                    p = end;
+                    if (*p != '/') {
+                        break;
+                    }
+                    ++p;
                 }
+                while (*p && !isspace(*p)) {
+                    ++p;
+                }
+                if (corners >= 3) {
+                    faces.v.push_back(faces.v[first]);
+                    faces.vt.push_back(faces.vt[first]);
+                    faces.vn.push_back(faces.vn[first]);
+                    faces.v.push_back(faces.v[faces.v.size() - 2]);
+                    faces.vt.push_back(faces.vt[faces.vt.size() - 2]);
+                    faces.vn.push_back(faces.vn[faces.vn.size() - 2]);
+                }
+                // in wavefront obj all indices start at 1, not zero
+                faces.v.push_back(idx[0] - 1);
+                faces.vt.push_back(idx[1] - 1);
+                faces.vn.push_back(idx[2] - 1);
+                missing_vt |= !idx[1];
+                missing_vn |= !idx[2];
+                ++corners;
             }
-            v_faces.push_back(vs);
-            vt_faces.push_back(vts);
-            vn_faces.push_back(vns);
-        } 
+            if (corners < 3) {
+                faces.v.resize(first);
+                faces.vt.resize(first);
+                faces.vn.resize(first);
+            }
+        }
+    }
+    /* Corners without texture coordinates or normals share a default one */
+    if (missing_vt) {
+        uvs.push_back(Vec2f(0, 0));
+        std::replace(faces.vt.begin(), faces.vt.end(), -1, uvs.size() - 1);
+    }
+    if (missing_vn) {
+        norms.push_back(Vec3f(0, 0, 1));
+        std::replace(faces.vn.begin(), faces.vn.end(), -1, norms.size() - 1);
+    }
+    std::cerr << "Read model with " << verts.size() << " vertices, "  << faces.size() << " faces\n";
+    load_timings.parse = timer.nsecsElapsed() - load_timings.textures;
+    buildLods();
+    optimizeLayout();
+    load_timings.prepare = timer.nsecsElapsed() - load_timings.textures - load_timings.parse;
+}
+
+void Model::buildLods() {
+    Vec3f lo = verts.isEmpty() ? Vec3f() : verts[0], hi = lo;
+    for (int i = 0; i < verts.size(); ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            lo[j] = std::min(lo[j], verts[i][j]);
+            hi[j] = std::max(hi[j], verts[i][j]);
+        }
+    }
+    bound_center = (lo + hi) * 0.5f;
+    for (int i = 0; i < verts.size(); ++i) {
+        bound_radius = std::max(bound_radius, (verts[i] - bound_center).len());
+    }
+
+    lod_first.push_back(0);
+    lod_first.push_back(faces.size());
+    lod_error.push_back(0);
+    meshopt::Faces level = faces;
+    /* Every level halves the previous one until seams and borders stop the mesh from shrinking */
+    while (nlods() < MAX_LODS && level.size() >= 64) {
+        meshopt::Faces next;
+        float error = meshopt::simplify(verts, level, level.size() / 2, next);
+        if (next.size() > level.size() * 3 / 4) {
+            break;
+        }
+        faces.v += next.v;
+        faces.vt += next.vt;
+        faces.vn += next.vn;
+        lod_first.push_back(faces.size());
+        lod_error.push_back(lod_error.last() + error);
+        level = next;
+    }
+    std::cerr << "Built " << nlods() << " levels of detail:";
+    for (int i = 0; i < nlods(); ++i) {
+        std::cerr << " " << lodFaces(i);
+    }
+    std::cerr << " faces\n";
+}
+
+void Model::optimizeLayout() {
+    if (faces.v.isEmpty()) {
+        return;
+    }
+    QVector<int> full = faces.v.mid(0, 3 * nfaces());
+    float before = meshopt::acmr(full, verts.size());
+
+    /* Triangle order inside every level of detail, then vertex order by first use */
+    meshopt::Faces res;
+    res.v.reserve(faces.v.size());
+    res.vt.reserve(faces.vt.size());
+    res.vn.reserve(faces.vn.size());
+    for (int lod = 0; lod < nlods(); ++lod) {
+        meshopt::Faces level;
+        level.v = faces.v.mid(3 * lodFirst(lod), 3 * lodFaces(lod));
+        level.vt = faces.vt.mid(3 * lodFirst(lod), 3 * lodFaces(lod));
+        level.vn = faces.vn.mid(3 * lodFirst(lod), 3 * lodFaces(lod));
+        meshopt::optimizeVertexCache(level, verts.size());
+        res.v += level.v;
+        res.vt += level.vt;
+        res.vn += level.vn;
+    }
+    QVector<int> v_remap = meshopt::fetchRemap(res.v, verts.size());
+    QVector<int> vt_remap = meshopt::fetchRemap(res.vt, uvs.size());
+    QVector<int> vn_remap = meshopt::fetchRemap(res.vn, norms.size());
+    for (int i = 0; i < res.v.size(); ++i) {
+        res.v[i] = v_remap[res.v[i]];
+        res.vt[i] = vt_remap[res.vt[i]];
+        res.vn[i] = vn_remap[res.vn[i]];
     }
-    std::cerr << "Read model with " << verts.size() << " vertices, "  << v_faces.size() << " faces\n";
+    QVector<Vec3f> new_verts(verts.size()), new_norms(norms.size());
+    QVector<Vec2f> new_uvs(uvs.size());
+    for (int i = 0; i < verts.size(); ++i) {
+        new_verts[v_remap[i]] = verts[i];
+    }
+    for (int i = 0; i < uvs.size(); ++i) {
+        new_uvs[vt_remap[i]] = uvs[i];
+    }
+    for (int i = 0; i < norms.size(); ++i) {
+        new_norms[vn_remap[i]] = norms[i];
+    }
+    verts = new_verts;
+    uvs = new_uvs;
+    norms = new_norms;
+    faces = res;
+
+    float after = meshopt::acmr(res.v.mid(0, 3 * nfaces()), verts.size());
+    std::cerr << "Vertex cache misses per triangle: " << before << " -> " << after
+              << " (" << after * nfaces() / std::max(1, verts.size()) << " transforms per vertex)\n";
+}
+
+const Model::LoadTimings& Model::loadTimings() const {
+    return load_timings;
+}
+
+qint64 Model::memoryUsage() const {
+    qint64 res = verts.size() * sizeof(Vec3f) + norms.size() * sizeof(Vec3f) + uvs.size() * sizeof(Vec2f);
+    res += (faces.v.size() + faces.vt.size() + faces.vn.size()) * sizeof(int);
+    res += lod_first.size() * sizeof(int) + lod_error.size() * sizeof(float);
+    const QImage* textures[] = {&diffuse, &normal_map, &spec, &glow_map};
+    for (size_t i = 0; i < 4; ++i) {
+        res += qint64(textures[i]->bytesPerLine()) * textures[i]->height();
+    }
+    return res;
 }
 
 Model::~Model() {
@@ -83,37 +280,88 @@ size_t Model::nverts() const {
 }
 
 size_t Model::nfaces() const {
-    return v_faces.size();
+    return lodFaces(0);
+}
+
+int Model::nlods() const {
+    return lod_error.size();
+}
+
+size_t Model::lodFirst(int lod) const {
+    assert(0 <= lod && lod < nlods());
+    return lod_first[lod];
+}
+
+size_t Model::lodFaces(int lod) const {
+    assert(0 <= lod && lod < nlods());
+    return lod_first[lod + 1] - lod_first[lod];
+}
+
+float Model::lodError(int lod) const {
+    assert(0 <= lod && lod < nlods());
+    return lod_error[lod];
+}
+
+const Vec3f& Model::center() const {
+    return bound_center;
+}
+
+float Model::radius() const {
+    return bound_radius;
 }
 
 Vec3f Model::vertex(int face, int vert) const {
-    assert(0 <= face && face < v_faces.size());
+    assert(0 <= face && face < faces.size());
     assert(0 <= vert && vert < 3);
-    return verts[v_faces[face][vert]];
+    return verts[faces.v[3 * face + vert]];
 }
 
 Vec3f Model::normal(int face, int vert) const {
-    assert(0 <= face && face < v_faces.size());
+    assert(0 <= face && face < faces.size());
     assert(0 <= vert && vert < 3);
-    return norms[vn_faces[face][vert]];
+    return norms[faces.vn[3 * face + vert]];
 }
 
 Vec2f Model::uv(int face, int vert) const {
-    assert(0 <= face && face < v_faces.size());
+    assert(0 <= face && face < faces.size());
     assert(0 <= vert && vert < 3);
-    return uvs[vt_faces[face][vert]];
+    return uvs[faces.vt[3 * face + vert]];
 }
 
 QRgb Model::texture(const Vec2f &uv) const {
     return diffuse.pixel(diffuse.width() * uv.x, diffuse.height() * (1.0f - uv.y));
 }
 
+bool Model::hasNormalMap() const {
+    return !normal_map.isNull();
+}
+
 Vec3f Model::normalMap(const Vec2f &uv) const {
+    assert(hasNormalMap());
     QRgb color = normal_map.pixel(normal_map.width() * uv.x, normal_map.height() * (1.0f - uv.y));
     Vec3f res(qRed(color) - 128, qGreen(color) - 128, qBlue(color) - 128);
     return res.normalize();
 }
 
 float Model::specular(const Vec2f &uv) const {
+    if (spec.isNull()) {
+        return 0;
+    }
     return qRed(spec.pixel(spec.width() * uv.x, spec.height() * (1.0f - uv.y)));
+}
+
+float Model::specularWeight() const {
+    /* Optional, the eye shells come without one */
+    return spec.isNull() ? 0.0f : 1.0f;
+}
+
+QRgb Model::glow(const Vec2f &uv) const {
+    if (glow_map.isNull()) {
+        return qRgb(0, 0, 0);
+    }
+    return glow_map.pixel(glow_map.width() * uv.x, glow_map.height() * (1.0f - uv.y));
+}
+
+bool Model::transparent() const {
+    return has_alpha;
 }
\ No newline at end of file
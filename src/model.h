@@ -6,22 +6,69 @@
 #include <string>
 
 #include "geometry.h"
+#include "meshopt.h"
+
+/* Texture paths of a model, empty paths are guessed from the .obj name */
+class Material {
+public:
+	/* Optional emission added to the lit color, only used when the file exists */
+	std::string diffuse, normal_map, specular, glow;
+};
 
 class Model {
 public:
-	Model(const std::string &filename);
+	Model(const std::string &filename, const Material &material = Material());
 	~Model();
+	/* Texture files a model reads, maps the material leaves out are found next to the .obj */
+	static Material textureFiles(const std::string &filename, const Material &material);
 	size_t nverts() const;
 	size_t nfaces() const;
 	Vec3f vertex(int face, int vert) const;
 	Vec3f normal(int face, int vert) const;
 	Vec2f uv(int face, int vert) const;
 	QRgb texture(const Vec2f &uv) const;
+	/* Object-space normal, only for models with a normal map */
+	bool hasNormalMap() const;
 	Vec3f normalMap(const Vec2f &uv) const;
+	/* Exponent of the highlight, and 1 for models with a specular map or 0 to leave the highlight out */
 	float specular(const Vec2f &uv) const;
+	float specularWeight() const;
+	QRgb glow(const Vec2f &uv) const;
+	/* The diffuse texture has texels with alpha below 255, the model is drawn in the transparency pass */
+	bool transparent() const;
+
+	static const int MAX_LODS = 4;
+	int nlods() const;
+	/* Faces of a level of detail are [lodFirst(lod), lodFirst(lod) + lodFaces(lod)) */
+	size_t lodFirst(int lod) const;
+	size_t lodFaces(int lod) const;
+	/* Estimated object-space distance between a level and the full mesh */
+	float lodError(int lod) const;
+	const Vec3f& center() const;
+	float radius() const;
+
+	/* Time spent in the steps of loading in nanoseconds */
+	class LoadTimings {
+	public:
+		LoadTimings();
+		qint64 textures, parse, prepare;
+	};
+	const LoadTimings& loadTimings() const;
+	/* Bytes held by the mesh and its decoded textures */
+	qint64 memoryUsage() const;
 private:
+	void buildLods();
+	void optimizeLayout();
+
 	QVector<Vec3f> verts, norms;
 	QVector<Vec2f> uvs;
-	QVector<QVector<int> > v_faces, vt_faces, vn_faces;
-	QImage diffuse, normal_map, spec;  
+	/* Triangles of every level of detail one after another */
+	meshopt::Faces faces;
+	QVector<int> lod_first;
+	QVector<float> lod_error;
+	Vec3f bound_center;
+	float bound_radius;
+	QImage diffuse, normal_map, spec, glow_map;
+	bool has_alpha;
+	LoadTimings load_timings;
 };
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include <cassert>
+#include <algorithm>
+#include <limits>
+
+#include "multisample.h"
+
+namespace {
+    /* Standard rotated-grid patterns in 1/16 pixel units */
+    const int PATTERN_2[2][2] = {{4, 4}, {-4, -4}};
+    const int PATTERN_4[4][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+    const int PATTERN_8[8][2] = {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+}
+
+gl::MultisampleBuffer::MultisampleBuffer(int width, int height, int samples)
+        : w(width), h(height), n(samples), colors(width * height * samples), depths(width * height * samples) {
+    assert(isSupported(samples));
+    const int (*pattern)[2] = samples == 2 ? PATTERN_2 : (samples == 4 ? PATTERN_4 : PATTERN_8);
+    for (int i = 0; i < samples; ++i) {
+        offsets[i] = Vec2f(pattern[i][0] / 16.0f, pattern[i][1] / 16.0f);
+    }
+}
+
+bool gl::MultisampleBuffer::isSupported(int samples) {
+    return samples == 2 || samples == 4 || samples == 8;
+}
+
+void gl::MultisampleBuffer::clear(int first, int last) {
+    std::fill(colors.begin() + first * w * n, colors.begin() + (last + 1) * w * n, qRgb(0, 0, 0));
+    std::fill(depths.begin() + first * w * n, depths.begin() + (last + 1) * w * n, -std::numeric_limits<float>::max());
+}
+
+void gl::MultisampleBuffer::resolve(Framebuffer &target, int first, int last) const {
+    assert(target.width == w && target.height == h && target.pixels);
+    const QRgb* src = colors.constData() + first * w * n;
+    for (int y = first; y <= last; ++y) {
+        QRgb* line = target.pixels + y * target.stride;
+        for (int x = 0; x < w; ++x, src += n) {
+            int r = 0, g = 0, b = 0;
+            for (int i = 0; i < n; ++i) {
+                r += qRed(src[i]);
+                g += qGreen(src[i]);
+                b += qBlue(src[i]);
+            }
+            line[x] = qRgb((r + n / 2) / n, (g + n / 2) / n, (b + n / 2) / n);
+        }
+    }
+    const float* depth = depths.constData() + first * w * n;
+    for (int i = first * w; i < (last + 1) * w; ++i, depth += n) {
+        target.zbuffer[i] = *std::max_element(depth, depth + n);
+    }
+}
\ No newline at end of file
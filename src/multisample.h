@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QImage>
+#include <QVector>
+
+#include "geometry.h"
+#include "framebuffer.h"
+
+namespace gl {
+    /* Color and depth storage with several coverage samples per pixel, samples of a pixel are contiguous */
+    class MultisampleBuffer {
+    public:
+        static const int MAX_SAMPLES = 8;
+
+        MultisampleBuffer(int width, int height, int samples);
+        static bool isSupported(int samples);
+
+        int width() const { return w; }
+        int height() const { return h; }
+        int samples() const { return n; }
+        /* Sample positions relative to the pixel position */
+        const Vec2f* pattern() const { return offsets; }
+
+        QRgb* color(int x, int y) { return colors.data() + (x + y * w) * n; }
+        float* depth(int x, int y) { return depths.data() + (x + y * w) * n; }
+
+        /* Works on rows first to last */
+        void clear(int first, int last);
+        /* Averages the samples into the color of a target of the same size, the nearest sample becomes its depth */
+        void resolve(Framebuffer &target, int first, int last) const;
+    private:
+        int w, h, n;
+        Vec2f offsets[MAX_SAMPLES];
+        QVector<QRgb> colors;
+        QVector<float> depths;
+    };
+}
\ No newline at end of file
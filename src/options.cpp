@@ -0,0 +1,99 @@
+#include <QCommandLineParser>
+#include <QThread>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <iostream>
+
+#include "options.h"
+
+Options::Options(): samples(1), lod_error(1), ssao(0), shadow_depth(32), size(1000, 700), stats(false), frames(1), fps(25), workers(1), cache_budget(1024) {}
+
+bool Options::parse(const QStringList &arguments, int &status) {
+    QCommandLineParser parser;
+    QCommandLineOption help_option = parser.addHelpOption();
+    parser.addPositionalArgument("models", "Paths to .obj files.", "[models...]");
+    QCommandLineOption msaa_option("msaa", "Antialias with <samples> (2, 4 or 8) coverage samples per pixel.", "samples", "1");
+    parser.addOption(msaa_option);
+    QCommandLineOption lod_option("lod-error", "Allow simplified meshes deviating up to <pixels> on screen, 0 disables them.", "pixels", "1");
+    parser.addOption(lod_option);
+    QCommandLineOption ssao_option("ssao", "Darken creases by up to <strength> (0 to 1) with screen-space ambient occlusion, 0 disables it.", "strength", "0");
+    parser.addOption(ssao_option);
+    QCommandLineOption shadow_depth_option("shadow-depth", "Store shadow maps with <bits> (16 or 24) bit fixed point depth, 32 keeps floats.", "bits", "32");
+    parser.addOption(shadow_depth_option);
+    QCommandLineOption scene_option("scene", "Load models, instances, camera and lights from a scene <file>.", "file");
+    parser.addOption(scene_option);
+    QCommandLineOption size_option("size", "Frame size <WxH>.", "size", "1000x700");
+    parser.addOption(size_option);
+    QCommandLineOption stats_option("stats", "Show frame statistics on top of the image.");
+    parser.addOption(stats_option);
+    QCommandLineOption trace_option("trace", "Write pass timings and counters to a Chrome trace <file> on exit.", "file");
+    parser.addOption(trace_option);
+    QCommandLineOption output_option("output", "Render without a window to <path>: an image sequence (frame_####.png or .ppm), "
+                                     "a .y4m video or raw .rgb frames.", "path");
+    parser.addOption(output_option);
+    QCommandLineOption frames_option("frames", "Number of frames of a turntable around the scene written to the output.", "n", "1");
+    parser.addOption(frames_option);
+    QCommandLineOption fps_option("fps", "Frame rate stored in .y4m output.", "fps", "25");
+    parser.addOption(fps_option);
+    QCommandLineOption serve_option("serve", "Render jobs received on the local socket <name> instead of opening a window.", "name");
+    parser.addOption(serve_option);
+    QCommandLineOption workers_option("workers", "Number of jobs the server renders at the same time, one per core by default.", "n");
+    parser.addOption(workers_option);
+    QCommandLineOption cache_option("cache", "Memory the server keeps unused models in, in <MiB>, 0 for no limit.", "MiB", "1024");
+    parser.addOption(cache_option);
+
+    status = 1;
+    if (!parser.parse(arguments)) {
+        std::cerr << parser.errorText().toStdString() << "\n";
+        return false;
+    }
+    if (parser.isSet(help_option)) {
+        std::cout << parser.helpText().toStdString();
+        status = 0;
+        return false;
+    }
+    models = parser.positionalArguments();
+    scene = parser.value(scene_option);
+    samples = parser.value(msaa_option).toInt();
+    lod_error = parser.value(lod_option).toFloat();
+    ssao = parser.value(ssao_option).toFloat();
+    shadow_depth = parser.value(shadow_depth_option).toInt();
+    QStringList wh = parser.value(size_option).split('x');
+    if (wh.size() != 2 || wh[0].toInt() <= 0 || wh[1].toInt() <= 0) {
+        std::cerr << "bad frame size " << parser.value(size_option).toStdString() << "\n";
+        return false;
+    }
+    size = QSize(wh[0].toInt(), wh[1].toInt());
+    stats = parser.isSet(stats_option);
+    trace = parser.value(trace_option);
+    output = parser.value(output_option);
+    frames = std::max(1, parser.value(frames_option).toInt());
+    fps = std::max(1, parser.value(fps_option).toInt());
+    serve = parser.value(serve_option);
+    workers = parser.isSet(workers_option) ? parser.value(workers_option).toInt() : QThread::idealThreadCount();
+    workers = std::max(1, workers);
+    cache_budget = std::max(0, parser.value(cache_option).toInt());
+    return true;
+}
+
+bool Options::setup(Scene* target) const {
+    QStringList paths = models;
+    if (!scene.isEmpty()) {
+        if (!target->load(scene)) {
+            return false;
+        }
+    } else if (paths.isEmpty()) {
+        paths.push_back("models/african_head/african_head.obj");
+        paths.push_back("models/african_head/african_head_eye_inner.obj");
+    }
+    for (int i = 0; i < paths.size(); ++i) {
+        /* Models load in the background, a missing file would only show up as an empty frame */
+        if (!QFileInfo(paths.at(i)).exists()) {
+            std::cerr << "Cannot read file " << paths.at(i).toStdString() << "\n";
+            return false;
+        }
+        target->addInstance(target->addModel(paths.at(i)));
+    }
+    return true;
+}
\ No newline at end of file
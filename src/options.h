@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QSize>
+
+#include "scene.h"
+
+/* Command line of the renderer, frames go to a file or a socket instead of a window when an output or a server name is given */
+class Options {
+public:
+    Options();
+    /* Returns false when the program should exit right away with the given status */
+    bool parse(const QStringList &arguments, int &status);
+    /*
+     * Adds the scene file or the listed models to a scene, the bundled head if neither is given.
+     * Returns false when the scene file or a model cannot be read.
+     */
+    bool setup(Scene* scene) const;
+
+    QStringList models;
+    QString scene;
+    int samples;
+    float lod_error;
+    float ssao;
+    int shadow_depth;
+    QSize size;
+    bool stats;
+    QString trace;
+    QString output;
+    int frames;
+    int fps;
+    QString serve;
+    int workers;
+    /* In MiB */
+    int cache_budget;
+};
\ No newline at end of file
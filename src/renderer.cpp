@@ -1,6 +1,7 @@
 #include <QPainter>
 #include <QPoint>
 #include <QDebug>
+#include <QElapsedTimer>
 
 #include <cstdlib>
 #include <cmath>
@@ -9,11 +10,19 @@
 #include <iostream>
 
 #include "renderer.h"
+#include "stats.h"
 
-DepthShader::DepthShader(Renderer* parent): parent(parent) {}
+ModelShader::ModelShader(const gl::RenderContext &context)
+        : context(context), uniform_m(context.projection * context.modelview), vertex_time(0) {}
+
+DepthShader::DepthShader(const gl::RenderContext &context): ModelShader(context), uniform_m_model(uniform_m) {}
+
+void DepthShader::bindInstance(const Matrix &transform) {
+    uniform_m_model = uniform_m * transform;
+}
 
 Vec4f DepthShader::vertex(int iface, int nthvert) {
-    Vec4f vertex = gl::projection * gl::modelview * embed<4>(parent->model->vertex(iface, nthvert));
+    Vec4f vertex = uniform_m_model * embed<4>(context.model->vertex(iface, nthvert));
     varying_clip.setCol(nthvert, vertex);
     return vertex;
 }
@@ -25,106 +34,605 @@ bool DepthShader::fragment(Vec3f bar, QRgb &color) {
     return false;
 }
 
-Shader::Shader(Renderer* parent, const Matrix &shadow_m): parent(parent) {
-    uniform_m = gl::projection * gl::modelview;
-    uniform_m_inv = (gl::projection * gl::rotate(parent->eye, parent->center, parent->up)).invertTranspose();
-    uniform_m_shadow = shadow_m * uniform_m.invert();
+size_t DepthShader::faceSize() const {
+    return sizeof(varying_clip);
+}
+
+void DepthShader::storeFace(char* face) const {
+    new (face) Matr<4, 3, float>(varying_clip);
+}
+
+void DepthShader::loadFace(const char* face, Matr<4, 3, float> &clip) {
+    clip = varying_clip = *reinterpret_cast<const Matr<4, 3, float>*>(face);
+}
+
+Shader::Shader(Renderer* parent, const gl::RenderContext &context, const LightGrid &light_grid)
+        : ModelShader(context), parent(parent), light_grid(light_grid) {
+    /* The modelview without its translation */
+    uniform_rot = context.modelview;
+    for (size_t i = 0; i < 3; ++i) {
+        uniform_rot[i][3] = 0;
+    }
+    uniform_m_inv = (context.projection * uniform_rot).invertTranspose();
+    Matrix m_inv = uniform_m.invert();
+    uniform_m_shadow = context.arena->alloc<Matrix>(parent->lights.size());
+    for (int i = 0; i < parent->lights.size(); ++i) {
+        new (&uniform_m_shadow[i]) Matrix(parent->lights[i].shadow_m * m_inv);
+    }
+    bindInstance(Matrix::identity());
+}
+
+void Shader::bindInstance(const Matrix &transform) {
+    uniform_model = transform;
+    uniform_m_model = uniform_m * transform;
+    /* Normals only take the linear part of the inverse transpose */
+    Matrix normal_m = transform.invertTranspose();
+    for (size_t i = 0; i < 3; ++i) {
+        normal_m[i][3] = normal_m[3][i] = 0;
+    }
+    normal_m[3][3] = 1;
+    uniform_m_inv_model = uniform_m_inv * normal_m;
 }
 
 Vec4f Shader::vertex(int iface, int nthvert) {
-    Vec4f vertex = uniform_m * embed<4>(parent->model->vertex(iface, nthvert));
+    Vec3f v = context.model->vertex(iface, nthvert);
+    Vec4f vertex = uniform_m_model * embed<4>(v);
     varying_clip.setCol(nthvert, vertex);
-    varying_uv.setCol(nthvert, parent->model->uv(iface, nthvert));
-    varying_norm.setCol(nthvert, uniform_m_inv * parent->model->normal(iface, nthvert));
+    varying_uv.setCol(nthvert, context.model->uv(iface, nthvert));
+    varying_norm.setCol(nthvert, uniform_m_inv_model * context.model->normal(iface, nthvert));
+    varying_pos.setCol(nthvert, uniform_model * v);
     return vertex;
 }
 
+size_t Shader::faceSize() const {
+    return sizeof(Face);
+}
+
+void Shader::storeFace(char* face) const {
+    Face* res = new (face) Face();
+    res->clip = varying_clip;
+    res->uv = varying_uv;
+    res->norm = varying_norm;
+    res->pos = varying_pos;
+}
+
+void Shader::loadFace(const char* face, Matr<4, 3, float> &clip) {
+    const Face &stored = *reinterpret_cast<const Face*>(face);
+    clip = varying_clip = stored.clip;
+    varying_uv = stored.uv;
+    varying_norm = stored.norm;
+    varying_pos = stored.pos;
+}
+
 bool Shader::fragment(Vec3f bar, QRgb &color) {
     Vec3f normal_approx = (varying_norm * bar).normalize();
     if (normal_approx * Vec3f(0, 0, 1) < 0) {
+        /* The far side of a transparent surface would be blended in as well */
         color = qRgb(0, 0, 0);
-        return false;
+        return context.model->transparent();
     }
     Vec2f uv = varying_uv * bar;
-    Vec3f normal = (uniform_m_inv * parent->model->normalMap(uv)).normalize();
-    Vec3f light = (gl::rotate(parent->eye, parent->center, parent->up) * parent->light_dir).normalize();
-    
-    Vec3f reflect = ((2.0f * normal * light) * normal - light).normalize();
-    float spec = pow(std::max(0.0f, reflect.z), parent->model->specular(uv) + 1);
-    
-    float intensity = std::max(0.0f, normal * light);
-
-    Vec3f shadow_pt = proj<3>(uniform_m_shadow * varying_clip * bar);
-    /* Magic const to prevent z-fighting */
-    float shadow = 0.3f + 0.7f * (parent->shadowbuffer[(int)shadow_pt.x + (int)shadow_pt.y * parent->width] < shadow_pt.z + 42.34);
-    
-    color = parent->model->texture(uv);
-    int rgb[3] = {qRed(color), qGreen(color), qBlue(color)};
+    /* Without a normal map the interpolated normal is all there is */
+    Vec3f normal = context.model->hasNormalMap() ? (uniform_m_inv_model * context.model->normalMap(uv)).normalize()
+                                                 : normal_approx;
+    float spec_power = context.model->specular(uv) + 1;
+    float spec_weight = 0.6f * context.model->specularWeight();
+    Vec3f pos = varying_pos * bar;
+
+    /* Only the lights that were binned into this fragment's tile are evaluated */
+    int tile = light_grid.tile(frag_coord.x, frag_coord.y);
+    const int* tile_lights = light_grid.lights(tile);
+    Vec3f lighting(0, 0, 0);
+    for (int k = light_grid.count(tile); k--; ) {
+        int idx = tile_lights[k];
+        const Light &l = parent->lights[idx];
+        Vec3f dir = l.vec;
+        float attenuation = 1.0f;
+        if (l.type == Light::POINT) {
+            dir = l.vec - pos;
+            float dist = dir.len();
+            if (dist >= l.radius) {
+                continue;
+            }
+            attenuation = (1.0f - dist / l.radius) * (1.0f - dist / l.radius);
+        }
+        Vec3f light = (uniform_rot * dir).normalize();
+        float intensity = std::max(0.0f, normal * light);
+        Vec3f reflect = ((2.0f * normal * light) * normal - light).normalize();
+        float spec = spec_weight ? pow(std::max(0.0f, reflect.z), spec_power) : 0.0f;
+
+        float shadow = 1.0f;
+        if (l.cast_shadows) {
+            Vec3f shadow_pt = proj<3>(uniform_m_shadow[idx] * varying_clip * bar);
+            int sx = shadow_pt.x, sy = shadow_pt.y;
+            if (sx >= 0 && sy >= 0 && sx < parent->width && sy < parent->height) {
+                /* Magic const to prevent z-fighting */
+                shadow = 0.3f + 0.7f * (l.shadowbuffer.depth(sx, sy) < shadow_pt.z + 42.34);
+            }
+        }
+        lighting += l.color * (shadow * attenuation * (intensity + spec_weight * spec));
+    }
+
+    QRgb texel = context.model->texture(uv), glow = context.model->glow(uv);
+    int rgb[3] = {qRed(texel), qGreen(texel), qBlue(texel)};
+    int emission[3] = {qRed(glow), qGreen(glow), qBlue(glow)};
     for (size_t i = 0; i < 3; ++i) {
-        rgb[i] = std::min<int>(255, 5 + rgb[i] * shadow * (intensity + 0.6 * spec));
+        rgb[i] = std::min<int>(255, 5 + rgb[i] * lighting[i] + emission[i]);
     }
-    color = qRgb(rgb[0], rgb[1], rgb[2]);
+    /* Alpha only matters to the transparency pass, textures of opaque models have none */
+    color = qRgba(rgb[0], rgb[1], rgb[2], qAlpha(texel));
     return false;
 }
 
-Renderer::Renderer(const QVector<QString> &model_filenames, int width, int height, QWidget* parent)
-        : parent(parent), width(width), height(height) {
-    for (int i = 0; i < model_filenames.size(); ++i) {
-        models.push_back(new Model(model_filenames[i].toStdString()));
+Renderer::Timings::Timings(): vertex(0), shadow(0), shading(0), occlusion(0) {}
+
+Renderer::Targets::Targets(): multisample(NULL), blend(NULL), occlusion(NULL) {}
+
+Renderer::Targets::~Targets() {
+    delete multisample;
+    delete blend;
+    delete occlusion;
+}
+
+Renderer::Renderer(Scene* scene, int width, int height, QObject* parent)
+        : QObject(parent), scene(scene), width(width), height(height), occlusion_strength(0), samples(1), shadow_depth(32),
+          lod_threshold(1), graph(&arena), passes(NULL), stats_frame(0) {
+    /* A square 1/8 of the height above the bottom row */
+    int size = height * 3 / 4;
+    viewport = gl::viewport_matrix((width - height) * 3 / 4, height - 1 - height / 8 - size, size, size);
+    eye = scene->camera().eye;
+    center = scene->camera().center;
+    up = scene->camera().up;
+    for (int i = 0; i < scene->lights().size(); ++i) {
+        addLight(scene->lights()[i]);
+    }
+    if (lights.isEmpty()) {
+        addLight(Light::directional(Vec3f(0, 0, 1)));
     }
-    light_dir = Vec3f(0, 0, 1);
-    eye = Vec3f(0, 0, 3);
-    center = Vec3f(0, 0, 0);
-    up = Vec3f(0, 1, 0);
-    zbuffer = new float[width * height];
-    shadowbuffer = new float[width * height];
 }
 
 Renderer::~Renderer() {
-    delete[] zbuffer;
-    delete[] shadowbuffer;
+    for (int i = 0; i < batch_targets.size(); ++i) {
+        delete batch_targets[i];
+    }
 }
 
-QImage Renderer::render(IShader& shader, float* zbuffer) {
-    QImage img(width, height, QImage::Format_RGB32);
-    img.fill(Qt::black);
-    std::fill(zbuffer, zbuffer + width * height, -std::numeric_limits<float>::max());
+bool Renderer::setSamples(int samples) {
+    if (samples != 1 && !gl::MultisampleBuffer::isSupported(samples)) {
+        std::cerr << "unsupported sample count " << samples << "\n";
+        return false;
+    }
+    this->samples = samples;
+    return true;
+}
 
-    light_dir.normalize();
+bool Renderer::setShadowDepth(int bits) {
+    if (!gl::DepthBuffer::isSupported(bits)) {
+        std::cerr << "unsupported shadow depth " << bits << "\n";
+        return false;
+    }
+    shadow_depth = bits;
+    for (int i = 0; i < lights.size(); ++i) {
+        if (lights[i].cast_shadows) {
+            lights[i].shadowbuffer.resize(width, height, bits);
+        }
+    }
+    return true;
+}
+
+void Renderer::addLight(const Light &light) {
+    lights.push_back(light);
+    if (light.cast_shadows) {
+        lights.last().shadowbuffer.resize(width, height, shadow_depth);
+    }
+}
+
+void Renderer::clearLights() {
+    lights.clear();
+}
+
+const Renderer::Timings& Renderer::lastTimings() const {
+    return timings;
+}
+
+void Renderer::setLodThreshold(float pixels) {
+    lod_threshold = pixels;
+}
+
+void Renderer::setAmbientOcclusion(float strength) {
+    occlusion_strength = std::max(0.0f, std::min(1.0f, strength));
+}
 
-    for (int k = 0; k < models.size(); ++k) {
-        model = models[k];
-        for (size_t i = 0; i < model->nfaces(); i++) {
+int Renderer::selectLod(const Model &model, const Matrix &mvp) const {
+    if (lod_threshold <= 0) {
+        return 0;
+    }
+    /* Scale at the point of the bounding sphere closest to the eye */
+    Vec3f dx(mvp[0][0], mvp[0][1], mvp[0][2]);
+    Vec3f dy(mvp[1][0], mvp[1][1], mvp[1][2]);
+    Vec3f dw(mvp[3][0], mvp[3][1], mvp[3][2]);
+    float w = (mvp * embed<4>(model.center()))[3] - dw.len() * model.radius();
+    if (w < 1e-3) {
+        return 0;
+    }
+    float pixels_per_unit = viewport[0][0] * std::max(dx.len(), dy.len()) / w;
+    for (int lod = model.nlods() - 1; lod > 0; --lod) {
+        if (model.lodError(lod) * pixels_per_unit <= lod_threshold) {
+            return lod;
+        }
+    }
+    return 0;
+}
+
+bool Renderer::hasTransparency() const {
+    for (int k = 0; k < scene->nmodels(); ++k) {
+        if (scene->model(k) && scene->model(k)->transparent()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename... Target>
+void Renderer::drawBand(Pass &pass, int band, int first, int last, Target&... target) {
+    gl::RenderContext &context = pass.contexts[band];
+    ModelShader &shader = *pass.shaders[band];
+    size_t size = shader.faceSize();
+    for (int k = first; k < last; ++k) {
+        const Instance &instance = pass.instances[k];
+        context.model = instance.model;
+        context.transform = instance.transform;
+        shader.bindInstance(instance.transform);
+        for (size_t i = 0; i < instance.count; ++i) {
+            const int* rows = instance.rows + 2 * i;
+            if (rows[1] < context.top || rows[0] > context.bottom) {
+                continue;
+            }
             Matr<4, 3, float> screen_coords;
-            for (size_t j = 0; j < 3; ++j) {
-                screen_coords.setCol(j, shader.vertex(i, j));
+            shader.loadFace(instance.faces + i * size, screen_coords);
+            gl::triangle(context, screen_coords, shader, target...);
+        }
+    }
+}
+
+void Renderer::prepare(QImage &image) const {
+    /* A frame the caller still holds stays untouched instead of being copied on write */
+    if (image.isNull() || !image.isDetached()) {
+        image = QImage(width, height, QImage::Format_RGB32);
+    }
+}
+
+void Renderer::prepare(Targets &targets) const {
+    targets.zbuffer.resize(width * height);
+    prepare(targets.image);
+    if (targets.multisample && targets.multisample->samples() != samples) {
+        delete targets.multisample;
+        targets.multisample = NULL;
+    }
+    if (samples > 1 && !targets.multisample) {
+        targets.multisample = new gl::MultisampleBuffer(width, height, samples);
+    }
+    if (hasTransparency() && !targets.blend) {
+        targets.blend = new gl::BlendBuffer(width, height);
+    }
+    if (occlusion_strength > 0 && !targets.occlusion) {
+        targets.occlusion = new gl::AmbientOcclusion(width, height);
+    } else if (occlusion_strength <= 0) {
+        delete targets.occlusion;
+        targets.occlusion = NULL;
+    }
+}
+
+template<typename MakeShader>
+Renderer::Pass* Renderer::addPass(const char* name, const gl::RenderContext &context, gl::Framebuffer* framebuffer,
+                                  bool transparent, MakeShader make_shader) {
+    Pass* pass = arena.alloc<Pass>(1);
+    pass->name = name;
+    pass->stats_pass = GL_STATS_ADD_PASS(stats_frame, name);
+    pass->framebuffer = framebuffer;
+    pass->depth = NULL;
+    pass->targets = NULL;
+    pass->nocclusion = 0;
+    pass->next = passes;
+    passes = pass;
+
+    pass->nbands = (height + BAND - 1) / BAND;
+    int rows = (height + pass->nbands - 1) / pass->nbands;
+    pass->contexts = arena.alloc<gl::RenderContext>(pass->nbands);
+    pass->shaders = arena.alloc<ModelShader*>(pass->nbands);
+    for (int b = 0; b < pass->nbands; ++b) {
+        gl::RenderContext* band = new (&pass->contexts[b]) gl::RenderContext(context);
+        band->top = b * rows;
+        band->bottom = std::min(height, (b + 1) * rows) - 1;
+        pass->shaders[b] = make_shader(*band);
+    }
+
+    int total = 0;
+    for (int k = 0; k < scene->nmodels(); ++k) {
+        /* Models still loading show up in a later frame */
+        if (scene->model(k) && (transparent || !scene->model(k)->transparent())) {
+            total += scene->instances(k).size();
+        }
+    }
+    pass->instances = arena.alloc<Instance>(total);
+    pass->vertex = graph.add([] {});
+    /* Opaque models first, then the transparent ones; a model that finished loading meanwhile waits for the next frame */
+    Instance* instance = pass->instances;
+    Instance* end = instance + total;
+    for (int layer = 0; layer < 2; ++layer) {
+        if (layer == 1) {
+            pass->ninstances = instance - pass->instances;
+            if (!transparent) {
+                break;
+            }
+        }
+        /* Instances are grouped by model so geometry and textures are shared and stay hot in cache */
+        for (int k = 0; k < scene->nmodels(); ++k) {
+            Model* model = scene->model(k);
+            if (!model || model->transparent() != (layer == 1)) {
+                continue;
+            }
+            const QVector<Matrix> &instances = scene->instances(k);
+            for (int n = 0; n < instances.size() && instance < end; ++n, ++instance) {
+                addInstance(pass, instance, model, instances[n], context, make_shader);
             }
-            gl::triangle(screen_coords, shader, img, zbuffer);
         }
     }
-    return img;
+    pass->ntransparent = instance - pass->instances - pass->ninstances;
+    return pass;
+}
+
+template<typename MakeShader>
+void Renderer::addInstance(Pass* pass, Instance* instance, const Model* model, const Matrix &transform,
+                           const gl::RenderContext &context, MakeShader make_shader) {
+    new (instance) Instance();
+    instance->model = model;
+    instance->transform = transform;
+    int lod = selectLod(*model, pass->shaders[0]->uniform_m * transform);
+    instance->first = model->lodFirst(lod);
+    instance->count = model->lodFaces(lod);
+    /* vertex() reads the model from the context, so the instance has both of its own */
+    gl::RenderContext* instance_context = new (arena.alloc<gl::RenderContext>(1)) gl::RenderContext(context);
+    instance_context->model = model;
+    instance_context->transform = transform;
+    instance->shader = make_shader(*instance_context);
+    instance->faces = arena.alloc<char>(instance->count * instance->shader->faceSize());
+    instance->rows = arena.alloc<int>(2 * instance->count);
+    graph.depend(pass->vertex, graph.add([=] { transformFaces(*instance); }));
+}
+
+void Renderer::transformFaces(Instance &instance) const {
+    ModelShader &shader = *instance.shader;
+    QElapsedTimer timer;
+    timer.start();
+    shader.bindInstance(instance.transform);
+    size_t size = shader.faceSize();
+    /* A row of margin for rounding; faces reaching behind the eye may touch any row */
+    for (size_t i = 0; i < instance.count; ++i) {
+        float top = std::numeric_limits<float>::max(), bottom = -top;
+        bool behind = false;
+        for (size_t j = 0; j < 3; ++j) {
+            Vec4f p = viewport * shader.vertex(instance.first + i, j);
+            behind |= !(p[3] > 0);
+            top = std::min(top, p[1] / p[3]);
+            bottom = std::max(bottom, p[1] / p[3]);
+        }
+        shader.storeFace(instance.faces + i * size);
+        int* rows = instance.rows + 2 * i;
+        if (behind) {
+            rows[0] = 0;
+            rows[1] = height - 1;
+            continue;
+        }
+        /* Faces off screen still go to the nearest band, so they are counted as culled once */
+        rows[0] = std::max(0.0f, std::min(height - 1.0f, std::floor(top) - 1));
+        rows[1] = std::max(0.0f, std::min(height - 1.0f, std::ceil(bottom) + 1));
+    }
+    shader.vertex_time = timer.nsecsElapsed();
+}
+
+void Renderer::renderBand(Pass &pass, int band) {
+    const gl::RenderContext &context = pass.contexts[band];
+    GL_STATS_BEGIN_BAND(stats_frame, pass.stats_pass);
+    gl::MultisampleBuffer* multisample = pass.targets ? pass.targets->multisample : NULL;
+    if (pass.depth) {
+        pass.depth->clear(context.top, context.bottom);
+        drawBand(pass, band, 0, pass.ninstances, *pass.depth);
+        GL_STATS_ADD(PIXELS_COVERED, pass.depth->covered(context.top, context.bottom));
+    } else {
+        gl::Framebuffer &framebuffer = *pass.framebuffer;
+        if (multisample) {
+            multisample->clear(context.top, context.bottom);
+            drawBand(pass, band, 0, pass.ninstances, *multisample);
+            multisample->resolve(framebuffer, context.top, context.bottom);
+        } else {
+            framebuffer.clear(context.top, context.bottom);
+            drawBand(pass, band, 0, pass.ninstances, framebuffer);
+        }
+        GL_STATS_ADD(PIXELS_COVERED, gl::Stats::covered(framebuffer.zbuffer + context.top * width,
+                                                        (context.bottom - context.top + 1) * width));
+    }
+    GL_STATS_END_BAND();
+}
+
+gl::TaskGraph::Task* Renderer::addShadows() {
+    gl::TaskGraph::Task* done = graph.add([this] { timings.shadow = frame_timer.nsecsElapsed(); });
+    for (int i = 0; i < lights.size(); ++i) {
+        Light &l = lights[i];
+        if (!l.cast_shadows) {
+            continue;
+        }
+        /* Point lights get a single perspective shadow frustum aimed at the origin */
+        gl::RenderContext context(viewport, gl::projection_matrix(l.type == Light::POINT ? -1.0f / l.vec.len() : 0),
+                                  gl::lookat_matrix(l.vec, Vec3f(0, 0, 0), up), &arena);
+        l.shadow_m = viewport * (context.projection * context.modelview);
+        Pass* pass = addPass("shadow", context, NULL, false, [this](gl::RenderContext &band) -> ModelShader* {
+            return new (arena.alloc<DepthShader>(1)) DepthShader(band);
+        });
+        /* Only depth is kept */
+        pass->depth = &l.shadowbuffer;
+        for (int b = 0; b < pass->nbands; ++b) {
+            gl::TaskGraph::Task* task = graph.add([=] { renderBand(*pass, b); });
+            graph.depend(task, pass->vertex);
+            graph.depend(done, task);
+        }
+    }
+    return done;
+}
+
+void Renderer::addView(const Camera &camera, Targets &targets, gl::TaskGraph::Task* shadows) {
+    prepare(targets);
+    gl::RenderContext context(viewport, gl::projection_matrix(-1.0f / (camera.eye - camera.center).len()),
+                              gl::lookat_matrix(camera.eye, camera.center, camera.up), &arena);
+    LightGrid* light_grid = new (arena.alloc<LightGrid>(1)) LightGrid();
+    light_grid->build(lights, viewport * context.projection * context.modelview, width, height, arena);
+    gl::Framebuffer* framebuffer = new (arena.alloc<gl::Framebuffer>(1))
+            gl::Framebuffer(&targets.image, targets.zbuffer.data(), width, height);
+    /* Transparent models need the blend buffer, which is only there if they were loaded when it was prepared */
+    Pass* pass = addPass("main", context, framebuffer, targets.blend, [=](gl::RenderContext &band) -> ModelShader* {
+        return new (arena.alloc<Shader>(1)) Shader(this, band, *light_grid);
+    });
+    pass->targets = &targets;
+    /* Shaders read the shadow maps, vertices are transformed before they are done */
+    gl::TaskGraph::Task* opaque = graph.add([] {});
+    gl::TaskGraph::Task* occluded = targets.occlusion ? addOcclusion(*pass, opaque) : NULL;
+    if (pass->ntransparent) {
+        pass->stats_transparent = GL_STATS_ADD_PASS(stats_frame, "transparent");
+    }
+    for (int b = 0; b < pass->nbands; ++b) {
+        gl::TaskGraph::Task* task = graph.add([=] { renderBand(*pass, b); });
+        graph.depend(task, pass->vertex);
+        graph.depend(task, shadows);
+        graph.depend(opaque, task);
+        if (pass->ntransparent) {
+            /* Over the opaque rows of the band, after ambient occlusion which reads the rows around them */
+            graph.depend(graph.add([=] { blendBand(*pass, b); }), occluded ? occluded : task);
+        }
+    }
+}
+
+gl::TaskGraph::Task* Renderer::addOcclusion(Pass &pass, gl::TaskGraph::Task* opaque) {
+    const gl::AmbientOcclusion &occlusion = *pass.targets->occlusion;
+    pass.stats_occlusion = GL_STATS_ADD_PASS(stats_frame, "ssao");
+    pass.nocclusion = 2 * occlusion.halfBands() + occlusion.fullBands();
+    pass.occlusion_times = arena.alloc<qint64>(pass.nocclusion);
+    /* A step reads the rows around its band, so it waits for the whole previous one */
+    gl::TaskGraph::Task* done = opaque;
+    for (int step = 0; step < 3; ++step) {
+        gl::TaskGraph::Task* previous = done;
+        done = graph.add([] {});
+        Pass* p = &pass;
+        for (int b = 0; b < (step < 2 ? occlusion.halfBands() : occlusion.fullBands()); ++b) {
+            gl::TaskGraph::Task* task = graph.add([=] { occludeBand(*p, step, b); });
+            graph.depend(task, previous);
+            graph.depend(done, task);
+        }
+    }
+    return done;
+}
+
+void Renderer::occludeBand(Pass &pass, int step, int band) {
+    QElapsedTimer timer;
+    timer.start();
+    GL_STATS_BEGIN_BAND(stats_frame, pass.stats_occlusion);
+    Targets &targets = *pass.targets;
+    const float* zbuffer = targets.zbuffer.constData();
+    float depth_scale = viewport[0][0] / viewport[2][2];
+    if (step == 0) {
+        targets.occlusion->downsample(band, zbuffer, depth_scale);
+    } else if (step == 1) {
+        targets.occlusion->occlude(band, occlusion_strength);
+    } else {
+        targets.occlusion->upsample(band, pass.framebuffer->pixels, pass.framebuffer->stride, zbuffer, depth_scale);
+    }
+    GL_STATS_END_BAND();
+    int half = targets.occlusion->halfBands();
+    pass.occlusion_times[step * half + band] = timer.nsecsElapsed();
+}
+
+void Renderer::blendBand(Pass &pass, int band) {
+    const gl::RenderContext &context = pass.contexts[band];
+    gl::BlendBuffer &blend = *pass.targets->blend;
+    /* Against the opaque depth of the band; with multisampling against the resolved depth, once per pixel */
+    const float* zbuffer = pass.framebuffer->zbuffer;
+    GL_STATS_BEGIN_BAND(stats_frame, pass.stats_transparent);
+    blend.clear(context.top, context.bottom);
+    drawBand(pass, band, pass.ninstances, pass.ninstances + pass.ntransparent, blend, zbuffer);
+    blend.resolve(*pass.framebuffer, context.top, context.bottom);
+    GL_STATS_END_BAND();
+}
+
+void Renderer::beginFrame() {
+    frame_timer.start();
+    stats_frame = GL_STATS_BEGIN_FRAME();
+    timings = Timings();
+    arena.reset();
+    graph.clear();
+    passes = NULL;
+}
+
+void Renderer::runFrame() {
+    graph.run();
+    for (Pass* pass = passes; pass; pass = pass->next) {
+        for (int b = 0; b < pass->nbands; ++b) {
+            timings.vertex += pass->shaders[b]->vertex_time;
+        }
+        for (int k = 0; k < pass->ninstances; ++k) {
+            timings.vertex += pass->instances[k].shader->vertex_time;
+        }
+        for (int i = 0; i < pass->nocclusion; ++i) {
+            timings.occlusion += pass->occlusion_times[i];
+        }
+    }
+    timings.shading = frame_timer.nsecsElapsed() - timings.shadow;
+    GL_STATS_END_FRAME(stats_frame);
 }
 
 QImage Renderer::genFrame() {
-    gl::set_viewport((width - height) * 3 / 4, height / 8, height * 3 / 4, height * 3 / 4);
+    beginFrame();
+    addView(camera(), frame_targets, addShadows());
+    runFrame();
+    return frame_targets.image;
+}
 
-    gl::lookat(light_dir, Vec3f(0, 0, 0), up);
-    gl::set_projection(0);
-    DepthShader depth_shader(this);
-    render(depth_shader, shadowbuffer);
-    Matrix shadow_m = gl::viewport * gl::projection * gl::modelview;
+QVector<QImage> Renderer::renderViews(const QVector<Camera> &cameras) {
+    beginFrame();
+    /* Lights, shadow maps and the scene are only read by the views, each view writes its own targets */
+    gl::TaskGraph::Task* shadows = addShadows();
+    while (batch_targets.size() < cameras.size()) {
+        batch_targets.push_back(new Targets());
+    }
+    for (int i = 0; i < cameras.size(); ++i) {
+        addView(cameras[i], *batch_targets[i], shadows);
+    }
+    runFrame();
+    QVector<QImage> frames;
+    for (int i = 0; i < cameras.size(); ++i) {
+        frames.push_back(batch_targets[i]->image);
+    }
+    return frames;
+}
+
+Camera Renderer::camera() const {
+    return Camera(eye, center, up);
+}
 
-    gl::lookat(eye, center, up);
-    gl::set_projection(-1.0f / (eye - center).len());
-    Shader shader(this, shadow_m);
-    QImage frame = render(shader, zbuffer);
-    return frame;
+void Renderer::setCamera(const Camera &camera) {
+    eye = camera.eye;
+    center = camera.center;
+    up = camera.up;
+    emit changed();
 }
 
 void Renderer::moveLight(QObject* o) {
     float pi = acos(-1.0);
     float step = pi / 18; // 10 degrees
     QPoint v = *(QPoint*)o;
+    if (lights.isEmpty()) {
+        return;
+    }
+    /* Arrows steer the key light */
+    Vec3f &light_dir = lights[0].vec;
 
     Vec3f z = (eye - center).normalize();
     Vec3f x = (up ^ z).normalize();
@@ -138,7 +646,7 @@ void Renderer::moveLight(QObject* o) {
     }
     light_dir.normalize();
 
-    parent->update();
+    emit changed();
 }
 
 void Renderer::moveEye(const QPoint &v) {
@@ -151,7 +659,12 @@ void Renderer::moveEye(const QPoint &v) {
     if (v.y() != 0) {
         eye = center + (eye - center).rotate((eye - center) ^ up, v.y() * step);
     }
-    parent->update();
+    emit changed();
+}
+
+void Renderer::orbitEye(float degrees) {
+    eye = camera().orbit(degrees).eye;
+    emit changed();
 }
 
 void Renderer::moveCenter(const QPoint &v) {
@@ -164,5 +677,5 @@ void Renderer::moveCenter(const QPoint &v) {
     center += x + z;
     eye += x + z;
 
-    parent->update();
+    emit changed();
 }
\ No newline at end of file
@@ -1,40 +1,83 @@
 #pragma once
 
-#include <QWidget>
+#include <QObject>
 #include <QImage>
 #include <QColor>
 #include <QVector>
 #include <QString>
+#include <QElapsedTimer>
 
 #include "geometry.h"
 #include "model.h"
+#include "scene.h"
+#include "light.h"
 #include "simplegl.h"
+#include "ssao.h"
+#include "taskgraph.h"
 
 class Renderer;
 
-class DepthShader: public IShader {
+/* Shaders of scene models, the model being drawn comes from the context of their pass */
+class ModelShader: public IShader {
+public:
+    ModelShader(const gl::RenderContext &context);
+    const gl::RenderContext &context;
+    /* Projection times modelview of the pass */
+    Matrix uniform_m;
+    /* Nanoseconds spent in vertex() */
+    qint64 vertex_time;
+
+    /* Bytes storeFace() writes */
+    virtual size_t faceSize() const = 0;
+    /* Keeps the varyings vertex() left for the three vertices of a face */
+    virtual void storeFace(char* face) const = 0;
+    /* Restores the varyings of a stored face as if vertex() had run for it, and its clip coordinates */
+    virtual void loadFace(const char* face, Matr<4, 3, float> &clip) = 0;
+};
+
+class DepthShader: public ModelShader {
 public:
     Matr<4, 3, float> varying_clip;
+    Matrix uniform_m_model;
 
-    DepthShader(Renderer* parent);
+    DepthShader(const gl::RenderContext &context);
     virtual Vec4f vertex(int iface, int nthvert);
     virtual bool fragment(Vec3f bar, QRgb &color);
-private:
-    Renderer* parent;
+    virtual void bindInstance(const Matrix &transform);
+    virtual size_t faceSize() const;
+    virtual void storeFace(char* face) const;
+    virtual void loadFace(const char* face, Matr<4, 3, float> &clip);
 };
 
-class Shader: public IShader {
+class Shader: public ModelShader {
 public:
     Matr<4, 3, float> varying_clip;
     Matr<2, 3, float> varying_uv;
     Matr<3, 3, float> varying_norm;
-    Matrix uniform_m, uniform_m_inv, uniform_m_shadow;
+    Matr<3, 3, float> varying_pos;
+    Matrix uniform_m_inv, uniform_rot;
+    Matrix uniform_model, uniform_m_model, uniform_m_inv_model;
+    /* One per light, in the arena of the frame */
+    Matrix* uniform_m_shadow;
 
-    Shader(Renderer* parent, const Matrix &shadow_m);
+    Shader(Renderer* parent, const gl::RenderContext &context, const LightGrid &light_grid);
     virtual Vec4f vertex(int iface, int nthvert);
     virtual bool fragment(Vec3f bar, QRgb &color);
+    virtual void bindInstance(const Matrix &transform);
+    virtual size_t faceSize() const;
+    virtual void storeFace(char* face) const;
+    virtual void loadFace(const char* face, Matr<4, 3, float> &clip);
 private:
+    /* What storeFace() keeps */
+    class Face {
+    public:
+        Matr<4, 3, float> clip;
+        Matr<2, 3, float> uv;
+        Matr<3, 3, float> norm, pos;
+    };
+
     Renderer* parent;
+    const LightGrid &light_grid;
 };
 
 class Renderer: public QObject {
@@ -42,20 +85,161 @@ class Renderer: public QObject {
     friend class DepthShader;
     friend class Shader;
 public:
-    Renderer(const QVector<QString> &model_filenames, int width, int height, QWidget* parent);
+    /*
+     * Stages of the last frame in nanoseconds: wall time until the shadow maps were done and after that, and the
+     * time spent in vertex shading and ambient occlusion summed over the threads, which overlaps the passes
+     */
+    class Timings {
+    public:
+        Timings();
+        qint64 vertex, shadow, shading, occlusion;
+    };
+
+    Renderer(Scene* scene, int width, int height, QObject* parent = 0);
     ~Renderer();
-    QImage render(IShader& shader, float* zbuffer);
+    /*
+     * Passes are split into bands of rows drawn by tasks on the global thread pool, the main pass starts
+     * transforming vertices while the shadow maps are drawn. Ambient occlusion runs in bands as well. Returns
+     * once the frame is done, so frames never overlap: the next one starts transforming vertices after this
+     * one is shaded.
+     */
     QImage genFrame();
+    /*
+     * Renders every camera with the current lights and settings. Shadow maps are drawn once for the batch,
+     * the bands of all views are drawn by the same tasks, so later views start while earlier ones finish.
+     * Like genFrame(), it returns once every view is done, consecutive batches do not overlap.
+     */
+    QVector<QImage> renderViews(const QVector<Camera> &cameras);
+    bool setSamples(int samples);
+    /* Bits per shadow map pixel: 16 or 24 bit fixed point, or 32 for float */
+    bool setShadowDepth(int bits);
+    /* Largest allowed screen-space error of simplified meshes, 0 always draws full detail */
+    void setLodThreshold(float pixels);
+    /* Darkens creases by up to strength (0 to 1) with screen-space ambient occlusion, 0 turns it off */
+    void setAmbientOcclusion(float strength);
     void moveEye(const QPoint &v);
+    /* Turns the eye around the center about the up axis */
+    void orbitEye(float degrees);
+    Camera camera() const;
+    void setCamera(const Camera &camera);
     void moveCenter(const QPoint &v);
+    void addLight(const Light &light);
+    void clearLights();
+    const Timings& lastTimings() const;
+signals:
+    /* The camera or the lights moved, the next frame will differ */
+    void changed();
 public slots:
     void moveLight(QObject* v);
 private:
-    QWidget* parent;
-    QVector<Model*> models;
-    Model* model;
+    /* Rows of a band at most */
+    static const int BAND = 32;
+
+    /* What a view is drawn into, genFrame() keeps its own and every view of a batch has one */
+    class Targets {
+    public:
+        Targets();
+        ~Targets();
+        QVector<float> zbuffer;
+        gl::MultisampleBuffer* multisample;
+        gl::BlendBuffer* blend;
+        gl::AmbientOcclusion* occlusion;
+        /* Reallocated only while a caller still holds the previous frame */
+        QImage image;
+    private:
+        Targets(const Targets&);
+        Targets& operator=(const Targets&);
+    };
+    /*
+     * Faces of a model instance in a pass, what vertex shading left for each of them and the first and last row
+     * each of them may touch. The shader of the instance only runs vertex(), the bands load what it stored.
+     */
+    class Instance {
+    public:
+        const Model* model;
+        Matrix transform;
+        size_t first, count;
+        ModelShader* shader;
+        char* faces;
+        int* rows;
+    };
+    /* A pass over the models of the scene, every band has a context and a shader of its own; lives in the arena */
+    class Pass {
+    public:
+        const char* name;
+        /* Numbers of the statistics of the frame */
+        int stats_pass, stats_occlusion, stats_transparent;
+        int nbands;
+        gl::RenderContext* contexts;
+        ModelShader** shaders;
+        /* The opaque instances, then the transparent ones if the pass has them */
+        Instance* instances;
+        int ninstances, ntransparent;
+        gl::Framebuffer* framebuffer;
+        /* Drawn to instead of the framebuffer by passes that only keep depth */
+        gl::DepthBuffer* depth;
+        /* Only for the main pass of a view */
+        Targets* targets;
+        /* Time of every ambient occlusion band */
+        qint64* occlusion_times;
+        int nocclusion;
+        /* Done when every face is transformed */
+        gl::TaskGraph::Task* vertex;
+        Pass* next;
+    };
+
+    /* Faces of the instances first to last of the pass that touch the rows of a band */
+    template<typename... Target>
+    void drawBand(Pass &pass, int band, int first, int last, Target&... target);
+    bool hasTransparency() const;
+    int selectLod(const Model &model, const Matrix &mvp) const;
+    void prepare(QImage &image) const;
+    /* Creates or drops the buffers the settings need */
+    void prepare(Targets &targets) const;
+    /*
+     * Sets up the bands of a pass and adds the tasks transforming its faces, make_shader(context) creates a shader.
+     * The pass holds the transparent models as well when transparent is set.
+     */
+    template<typename MakeShader>
+    Pass* addPass(const char* name, const gl::RenderContext &context, gl::Framebuffer* framebuffer, bool transparent,
+                  MakeShader make_shader);
+    template<typename MakeShader>
+    void addInstance(Pass* pass, Instance* instance, const Model* model, const Matrix &transform,
+                     const gl::RenderContext &context, MakeShader make_shader);
+    /* Runs vertex() once for every face of the instance, storing the varyings and the rows */
+    void transformFaces(Instance &instance) const;
+    void renderBand(Pass &pass, int band);
+    /* Returns the task done once every shadow map is */
+    gl::TaskGraph::Task* addShadows();
+    /* Occlusion is applied to the opaque result and transparent models are blended over it when the targets have the buffers */
+    void addView(const Camera &camera, Targets &targets, gl::TaskGraph::Task* shadows);
+    /* Adds the steps of ambient occlusion after opaque and returns the task done once the last one is */
+    gl::TaskGraph::Task* addOcclusion(Pass &pass, gl::TaskGraph::Task* opaque);
+    void occludeBand(Pass &pass, int step, int band);
+    /* Blends the transparent models over the rows of a band */
+    void blendBand(Pass &pass, int band);
+    /* Clears the tasks and the arena of the previous frame */
+    void beginFrame();
+    /* Runs the tasks of the frame and fills in the timings */
+    void runFrame();
+
+    Scene* scene;
     int width, height;
-    float* zbuffer;
-    float* shadowbuffer;
-    Vec3f light_dir, eye, center, up;
+    Matrix viewport;
+    float occlusion_strength;
+    int samples;
+    int shadow_depth;
+    float lod_threshold;
+    QVector<Light> lights;
+    Vec3f eye, center, up;
+    Timings timings;
+    /* Reused by every frame, so drawing one does not touch the heap once they have grown */
+    gl::Arena arena;
+    gl::TaskGraph graph;
+    /* Passes of the frame, newest first */
+    Pass* passes;
+    QElapsedTimer frame_timer;
+    int stats_frame;
+    Targets frame_targets;
+    QVector<Targets*> batch_targets;
 };
\ No newline at end of file
@@ -0,0 +1,209 @@
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QFileInfo>
+#include <QBuffer>
+
+#include <sstream>
+#include <string>
+#include <iostream>
+
+#include "renderserver.h"
+#include "renderer.h"
+
+namespace {
+    bool readVec(std::istream &in, Vec3f &v) {
+        return (bool)(in >> v.x >> v.y >> v.z);
+    }
+
+    QByteArray error(const QString &message) {
+        return "error " + message.toUtf8() + "\n";
+    }
+}
+
+RenderJob::RenderJob(): size(1000, 700), camera_fields(0), samples(1), lod_error(1), ssao(0), shadow_depth(32), format("png") {}
+
+bool RenderJob::parse(const QString &line, QString &error) {
+    std::istringstream iss(line.toStdString());
+    std::string cmd, key, value;
+    if (!(iss >> cmd) || cmd != "render") {
+        error = "unknown request";
+        return false;
+    }
+    while (iss >> key) {
+        bool ok = true;
+        if (key == "scene") {
+            ok = (bool)(iss >> value);
+            scene = QString::fromStdString(value);
+        } else if (key == "model") {
+            ok = (bool)(iss >> value);
+            models.push_back(QString::fromStdString(value));
+        } else if (key == "size") {
+            int w = 0, h = 0;
+            char x = 0;
+            ok = iss >> w >> x >> h && x == 'x' && w > 0 && h > 0;
+            if (ok && (w > MAX_SIDE || h > MAX_SIDE || qint64(w) * h > MAX_PIXELS)) {
+                error = "size too large";
+                return false;
+            }
+            size = QSize(w, h);
+        } else if (key == "eye") {
+            ok = readVec(iss, camera.eye);
+            camera_fields |= EYE;
+        } else if (key == "center") {
+            ok = readVec(iss, camera.center);
+            camera_fields |= CENTER;
+        } else if (key == "up") {
+            ok = readVec(iss, camera.up);
+            camera_fields |= UP;
+        } else if (key == "light") {
+            Vec3f dir;
+            ok = readVec(iss, dir);
+            lights.push_back(dir);
+        } else if (key == "msaa") {
+            ok = (bool)(iss >> samples);
+        } else if (key == "lod-error") {
+            ok = (bool)(iss >> lod_error);
+        } else if (key == "ssao") {
+            ok = (bool)(iss >> ssao);
+        } else if (key == "shadow-depth") {
+            ok = (bool)(iss >> shadow_depth);
+        } else if (key == "format") {
+            ok = iss >> value && (value == "png" || value == "ppm" || value == "bmp");
+            format = QByteArray(value.c_str());
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            error = "cannot parse '" + QString::fromStdString(key) + "'";
+            return false;
+        }
+    }
+    if (scene.isEmpty() && models.isEmpty()) {
+        error = "nothing to render";
+        return false;
+    }
+    return true;
+}
+
+RenderServer::RenderServer(int workers, qint64 cache_budget, QObject* parent): QObject(parent), cache(cache_budget) {
+    pool.setMaxThreadCount(workers);
+    connect(&server, SIGNAL(newConnection()), this, SLOT(accept()));
+}
+
+RenderServer::~RenderServer() {
+    /* Jobs still running use the cache */
+    pool.waitForDone();
+}
+
+bool RenderServer::listen(const QString &name) {
+    /* A server that crashed leaves its socket file behind */
+    QLocalServer::removeServer(name);
+    if (!server.listen(name)) {
+        std::cerr << "can't listen on " << name.toStdString() << ": " << server.errorString().toStdString() << "\n";
+        return false;
+    }
+    std::cerr << "listening on " << server.fullServerName().toStdString() << " with " << pool.maxThreadCount()
+              << " workers\n";
+    return true;
+}
+
+void RenderServer::accept() {
+    while (QLocalSocket* socket = server.nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(read()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(drop()));
+    }
+}
+
+void RenderServer::read() {
+    next(static_cast<QLocalSocket*>(sender()));
+}
+
+void RenderServer::next(QLocalSocket* socket) {
+    while (!busy.contains(socket) && socket->canReadLine()) {
+        QString line = QString::fromUtf8(socket->readLine()).trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        RenderJob job;
+        QString message;
+        if (!job.parse(line, message)) {
+            socket->write(error(message));
+            continue;
+        }
+        busy.insert(socket);
+        /* The watcher dies with its connection, a job whose client left still finishes but is not answered */
+        QFutureWatcher<QByteArray>* watcher = new QFutureWatcher<QByteArray>(socket);
+        connect(watcher, SIGNAL(finished()), this, SLOT(finish()));
+        watcher->setFuture(QtConcurrent::run(&pool, this, &RenderServer::render, job));
+    }
+}
+
+void RenderServer::finish() {
+    QFutureWatcher<QByteArray>* watcher = static_cast<QFutureWatcher<QByteArray>*>(sender());
+    QLocalSocket* socket = static_cast<QLocalSocket*>(watcher->parent());
+    socket->write(watcher->result());
+    watcher->deleteLater();
+    busy.remove(socket);
+    next(socket);
+}
+
+void RenderServer::drop() {
+    QLocalSocket* socket = static_cast<QLocalSocket*>(sender());
+    busy.remove(socket);
+    socket->deleteLater();
+}
+
+QByteArray RenderServer::render(const RenderJob &job) {
+    Scene scene(&cache);
+    if (!job.scene.isEmpty() && !scene.load(job.scene)) {
+        return error("cannot load scene " + job.scene);
+    }
+    for (int i = 0; i < job.models.size(); ++i) {
+        if (!QFileInfo(job.models[i]).exists()) {
+            return error("cannot read " + job.models[i]);
+        }
+        scene.addInstance(scene.addModel(job.models[i]));
+    }
+    scene.waitForAssets();
+    for (int i = 0; i < scene.nmodels(); ++i) {
+        /* A mesh that could not be read has no faces */
+        if (!scene.model(i)->nfaces()) {
+            return error("cannot load model " + scene.modelFile(i));
+        }
+    }
+
+    Renderer renderer(&scene, job.size.width(), job.size.height());
+    if (!renderer.setSamples(job.samples)) {
+        return error("unsupported sample count");
+    }
+    if (!renderer.setShadowDepth(job.shadow_depth)) {
+        return error("unsupported shadow depth");
+    }
+    renderer.setLodThreshold(job.lod_error);
+    renderer.setAmbientOcclusion(job.ssao);
+    Camera camera = renderer.camera();
+    if (job.camera_fields & RenderJob::EYE) {
+        camera.eye = job.camera.eye;
+    }
+    if (job.camera_fields & RenderJob::CENTER) {
+        camera.center = job.camera.center;
+    }
+    if (job.camera_fields & RenderJob::UP) {
+        camera.up = job.camera.up;
+    }
+    renderer.setCamera(camera);
+    if (!job.lights.isEmpty()) {
+        renderer.clearLights();
+        for (int i = 0; i < job.lights.size(); ++i) {
+            renderer.addLight(Light::directional(job.lights[i]));
+        }
+    }
+
+    QByteArray image;
+    QBuffer buffer(&image);
+    buffer.open(QIODevice::WriteOnly);
+    if (!renderer.genFrame().save(&buffer, job.format.constData())) {
+        return error("cannot encode " + QString::fromUtf8(job.format));
+    }
+    return "ok " + QByteArray::number(image.size()) + "\n" + image;
+}
\ No newline at end of file
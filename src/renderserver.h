@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QSize>
+#include <QVector>
+#include <QSet>
+#include <QThreadPool>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+#include "geometry.h"
+#include "scene.h"
+#include "assetcache.h"
+
+/* One request of the server protocol, the syntax is described in README.md */
+class RenderJob {
+public:
+    enum CameraField {
+        EYE = 1, CENTER = 2, UP = 4
+    };
+    /* Larger frames are refused rather than failing to allocate on a worker */
+    static const int MAX_SIDE = 16384;
+    static const qint64 MAX_PIXELS = 1 << 26;
+
+    RenderJob();
+    /* Reads a request line, error tells what is wrong with it */
+    bool parse(const QString &line, QString &error);
+
+    QString scene;
+    QStringList models;
+    QSize size;
+    /* Only the fields set in camera_fields replace those of the scene camera */
+    Camera camera;
+    int camera_fields;
+    /* Shadowed directional lights replacing the lights of the scene */
+    QVector<Vec3f> lights;
+    int samples;
+    float lod_error;
+    float ssao;
+    int shadow_depth;
+    QByteArray format;
+};
+
+/*
+ * Renders jobs received over a local socket on a pool of worker threads. Models stay in an asset cache
+ * between jobs up to its budget, so usually only the first job using an asset pays for loading it.
+ * Requests of a connection are answered in order, connections are served in parallel.
+ */
+class RenderServer: public QObject {
+    Q_OBJECT
+public:
+    /* The cache budget is in bytes, 0 keeps every model */
+    RenderServer(int workers, qint64 cache_budget, QObject* parent = 0);
+    ~RenderServer();
+    bool listen(const QString &name);
+    /* Renders on the calling thread, returns the whole reply */
+    QByteArray render(const RenderJob &job);
+private slots:
+    void accept();
+    void read();
+    void finish();
+    void drop();
+private:
+    /* Starts the next request of a connection unless one is being rendered */
+    void next(QLocalSocket* socket);
+
+    QLocalServer server;
+    QThreadPool pool;
+    AssetCache cache;
+    QSet<QLocalSocket*> busy;
+};
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cmath>
+#include <cassert>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QtConcurrent>
+
+#include "scene.h"
+
+namespace {
+    bool readVec(std::istream &in, Vec3f &v) {
+        return (bool)(in >> v.x >> v.y >> v.z);
+    }
+
+    /* The same mesh with other textures is another model */
+    QString modelKey(const QString &filename, const Material &material) {
+        return filename + "|" + QString::fromStdString(material.diffuse) + "|" + QString::fromStdString(material.normal_map)
+               + "|" + QString::fromStdString(material.specular) + "|" + QString::fromStdString(material.glow);
+    }
+}
+
+Camera::Camera(): eye(0, 0, 3), center(0, 0, 0), up(0, 1, 0) {}
+
+Camera::Camera(const Vec3f &eye, const Vec3f &center, const Vec3f &up): eye(eye), center(center), up(up) {}
+
+Camera Camera::orbit(float degrees) const {
+    float pi = acos(-1.0);
+    return Camera(center + (eye - center).rotate(up, degrees * pi / 180), center, up);
+}
+
+Scene::Scene(QObject* parent): QObject(parent), cache(NULL) {
+}
+
+Scene::Scene(AssetCache* cache, QObject* parent): QObject(parent), cache(cache) {
+}
+
+Scene::~Scene() {
+    waitForAssets();
+    for (int i = 0; i < assets.size(); ++i) {
+        delete assets[i];
+    }
+}
+
+bool Scene::load(const QString &filename) {
+    std::ifstream in(filename.toStdString());
+    if (in.fail()) {
+        std::cerr << "Cannot read file " << filename.toStdString() << std::endl;
+        return false;
+    }
+    /* Relative asset paths are resolved against the directory of the scene file */
+    QDir dir = QFileInfo(filename).dir();
+    QHash<QString, Material> materials;
+    QHash<QString, int> names;
+    std::string line;
+    for (int lineno = 1; std::getline(in, line); ++lineno) {
+        std::istringstream iss(line.c_str());
+        std::string cmd, name, key, value;
+        if (!(iss >> cmd) || cmd[0] == '#') {
+            continue;
+        }
+        bool ok = true;
+        if (cmd == "material") {
+            Material material;
+            ok = (bool)(iss >> name);
+            while (ok && iss >> key) {
+                ok = (bool)(iss >> value);
+                std::string path = dir.filePath(QString::fromStdString(value)).toStdString();
+                if (key == "diffuse") {
+                    material.diffuse = path;
+                } else if (key == "normal") {
+                    material.normal_map = path;
+                } else if (key == "specular") {
+                    material.specular = path;
+                } else if (key == "glow") {
+                    material.glow = path;
+                } else {
+                    ok = false;
+                }
+            }
+            materials.insert(QString::fromStdString(name), material);
+        } else if (cmd == "model") {
+            Material material;
+            ok = (bool)(iss >> name >> value);
+            while (ok && iss >> key) {
+                ok = key == "material" && iss >> key && materials.contains(QString::fromStdString(key));
+                if (ok) {
+                    material = materials.value(QString::fromStdString(key));
+                }
+            }
+            if (ok) {
+                names.insert(QString::fromStdString(name), addModel(dir.filePath(QString::fromStdString(value)), material));
+            }
+        } else if (cmd == "instance") {
+            Vec3f position, rotation;
+            float scale = 1;
+            ok = iss >> name && names.contains(QString::fromStdString(name));
+            while (ok && iss >> key) {
+                if (key == "position") {
+                    ok = readVec(iss, position);
+                } else if (key == "rotation") {
+                    ok = readVec(iss, rotation);
+                } else if (key == "scale") {
+                    ok = (bool)(iss >> scale);
+                } else {
+                    ok = false;
+                }
+            }
+            if (ok) {
+                addInstance(names.value(QString::fromStdString(name)), transform(position, rotation, scale));
+            }
+        } else if (cmd == "camera") {
+            while (ok && iss >> key) {
+                if (key == "eye") {
+                    ok = readVec(iss, cam.eye);
+                } else if (key == "center") {
+                    ok = readVec(iss, cam.center);
+                } else if (key == "up") {
+                    ok = readVec(iss, cam.up);
+                } else {
+                    ok = false;
+                }
+            }
+        } else if (cmd == "light") {
+            Vec3f vec, color(1, 1, 1);
+            float radius = 1;
+            ok = iss >> name && (name == "directional" || name == "point") && readVec(iss, vec);
+            /* The defaults of Light::directional() and Light::point() */
+            bool shadows = name == "directional";
+            while (ok && iss >> key) {
+                if (key == "color") {
+                    ok = readVec(iss, color);
+                } else if (key == "radius") {
+                    ok = (bool)(iss >> radius);
+                } else if (key == "shadows") {
+                    shadows = true;
+                } else if (key == "noshadows") {
+                    shadows = false;
+                } else {
+                    ok = false;
+                }
+            }
+            if (ok) {
+                scene_lights.push_back(name == "point" ? Light::point(vec, radius, color, shadows) : Light::directional(vec, color, shadows));
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << filename.toStdString() << ":" << lineno << ": cannot parse '" << line << "'" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int Scene::addModel(const QString &filename, const Material &material) {
+    QString key = modelKey(filename, material);
+    if (model_index.contains(key)) {
+        return model_index.value(key);
+    }
+    Asset* asset = new Asset;
+    asset->filename = filename;
+    asset->material = material;
+    assets.push_back(asset);
+    model_index.insert(key, assets.size() - 1);
+    asset->loading = QtConcurrent::run(this, &Scene::loadAsset, asset, assets.size() - 1);
+    return assets.size() - 1;
+}
+
+void Scene::loadAsset(Asset* asset, int index) {
+    asset->shared = cache ? cache->load(asset->filename, asset->material)
+                          : QSharedPointer<Model>(new Model(asset->filename.toStdString(), asset->material));
+    asset->model.storeRelease(asset->shared.data());
+    emit assetLoaded(index);
+}
+
+void Scene::addInstance(int model, const Matrix &transform) {
+    assert(0 <= model && model < assets.size());
+    assets[model]->transforms.push_back(transform);
+}
+
+int Scene::nmodels() const {
+    return assets.size();
+}
+
+Model* Scene::model(int i) const {
+    assert(0 <= i && i < assets.size());
+    return assets[i]->model.loadAcquire();
+}
+
+const QString& Scene::modelFile(int i) const {
+    assert(0 <= i && i < assets.size());
+    return assets[i]->filename;
+}
+
+const QVector<Matrix>& Scene::instances(int model) const {
+    assert(0 <= model && model < assets.size());
+    return assets[model]->transforms;
+}
+
+int Scene::ninstances() const {
+    int res = 0;
+    for (int i = 0; i < assets.size(); ++i) {
+        res += assets[i]->transforms.size();
+    }
+    return res;
+}
+
+bool Scene::isLoading() const {
+    for (int i = 0; i < assets.size(); ++i) {
+        if (!assets[i]->loading.isFinished()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scene::waitForAssets() {
+    for (int i = 0; i < assets.size(); ++i) {
+        assets[i]->loading.waitForFinished();
+    }
+}
+
+const Camera& Scene::camera() const {
+    return cam;
+}
+
+const QVector<Light>& Scene::lights() const {
+    return scene_lights;
+}
+
+Matrix Scene::transform(const Vec3f &translation, const Vec3f &rotation, float scale) {
+    float deg = std::acos(-1.0f) / 180;
+    Matrix res = Matrix::identity();
+    for (size_t i = 0; i < 3; ++i) {
+        Vec3f v;
+        v[i] = scale;
+        v = v.rotate(Vec3f(0, 0, 1), rotation.z * deg);
+        v = v.rotate(Vec3f(1, 0, 0), rotation.x * deg);
+        v = v.rotate(Vec3f(0, 1, 0), rotation.y * deg);
+        for (size_t j = 0; j < 3; ++j) {
+            res[j][i] = v[j];
+        }
+        res[i][3] = translation[i];
+    }
+    return res;
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QAtomicPointer>
+#include <QFuture>
+#include <QSharedPointer>
+
+#include "geometry.h"
+#include "model.h"
+#include "light.h"
+#include "assetcache.h"
+
+class Camera {
+public:
+    Camera();
+    Camera(const Vec3f &eye, const Vec3f &center, const Vec3f &up);
+    /* The eye turned around the center about the up axis */
+    Camera orbit(float degrees) const;
+
+    Vec3f eye, center, up;
+};
+
+/*
+ * Shared model assets and the instances placing them in the world.
+ * Models are loaded in the background, model() returns NULL until an asset is ready.
+ */
+class Scene: public QObject {
+    Q_OBJECT
+public:
+    Scene(QObject* parent = 0);
+    /* Models come from the cache, which may keep them after the scene is gone */
+    Scene(AssetCache* cache, QObject* parent = 0);
+    ~Scene();
+    /* Reads a scene description file, the format is described in README.md */
+    bool load(const QString &filename);
+    /* Schedules loading once, later calls with the same path and material return the same index */
+    int addModel(const QString &filename, const Material &material = Material());
+    void addInstance(int model, const Matrix &transform = Matrix::identity());
+    int nmodels() const;
+    Model* model(int i) const;
+    const QString& modelFile(int i) const;
+    const QVector<Matrix>& instances(int model) const;
+    int ninstances() const;
+    bool isLoading() const;
+    void waitForAssets();
+
+    const Camera& camera() const;
+    const QVector<Light>& lights() const;
+
+    /* Scale, then rotate by Euler angles in degrees (roll around z, pitch around x, yaw around y), then translate */
+    static Matrix transform(const Vec3f &translation, const Vec3f &rotation = Vec3f(0, 0, 0), float scale = 1);
+signals:
+    /* Emitted from the loading thread */
+    void assetLoaded(int model);
+private:
+    class Asset {
+    public:
+        QString filename;
+        Material material;
+        QSharedPointer<Model> shared;
+        /* Published once shared is set */
+        QAtomicPointer<Model> model;
+        QFuture<void> loading;
+        QVector<Matrix> transforms;
+    };
+
+    Scene(const Scene&);
+    Scene& operator=(const Scene&);
+    void loadAsset(Asset* asset, int index);
+
+    AssetCache* cache;
+    QVector<Asset*> assets;
+    /* Keyed by path and material */
+    QHash<QString, int> model_index;
+    Camera cam;
+    QVector<Light> scene_lights;
+};
\ No newline at end of file
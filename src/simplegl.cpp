@@ -1,13 +1,18 @@
 #include <cassert>
+#include <cmath>
 #include <algorithm>
+#include <limits>
+#include <climits>
 
 #include "simplegl.h"
+#include "stats.h"
 
-Matrix gl::viewport;
-Matrix gl::projection;
-Matrix gl::modelview;
 int const gl::DEPTH = 1000;
 
+gl::RenderContext::RenderContext(const Matrix &viewport, const Matrix &projection, const Matrix &modelview, Arena* arena)
+        : viewport(viewport), projection(projection), modelview(modelview), arena(arena), model(NULL), transform(Matrix::identity()),
+          top(0), bottom(INT_MAX) {}
+
 Matrix gl::rotate(const Vec3f &eye, const Vec3f &center, const Vec3f &up) {
     Vec3f z = (eye - center).normalize();
     Vec3f x = (up ^ z).normalize();
@@ -21,28 +26,31 @@ Matrix gl::rotate(const Vec3f &eye, const Vec3f &center, const Vec3f &up) {
     return res;
 }
 
-void gl::lookat(const Vec3f &eye, const Vec3f &center, const Vec3f &up) {
+Matrix gl::lookat_matrix(const Vec3f &eye, const Vec3f &center, const Vec3f &up) {
     Matrix move = Matrix::identity();
     for (size_t i = 0; i < 3; ++i) {
         move[i][3] = -center[i];
     }
-    modelview = rotate(eye, center, up) * move;
+    return rotate(eye, center, up) * move;
 }
 
-void gl::set_viewport(int x, int y, int w, int h) {
-    viewport = Matrix::identity();
-    viewport[0][3] = x + w / 2.0f;
-    viewport[1][3] = y + h / 2.0f;
-    viewport[2][3] = DEPTH / 2.0f;
+Matrix gl::viewport_matrix(int x, int y, int w, int h) {
+    Matrix res = Matrix::identity();
+    res[0][3] = x + w / 2.0f;
+    res[1][3] = y + h / 2.0f;
+    res[2][3] = DEPTH / 2.0f;
 
-    viewport[0][0] = w / 2.0f;
-    viewport[1][1] = h / 2.0f;
-    viewport[2][2] = DEPTH / 2.0f;
+    /* Rows are stored top to bottom like QImage, flipping here saves mirroring every frame */
+    res[0][0] = w / 2.0f;
+    res[1][1] = -h / 2.0f;
+    res[2][2] = DEPTH / 2.0f;
+    return res;
 }
 
-void gl::set_projection(float coeff) {
-    projection = Matrix::identity();
-    projection[3][2] = coeff;
+Matrix gl::projection_matrix(float coeff) {
+    Matrix res = Matrix::identity();
+    res[3][2] = coeff;
+    return res;
 }
 
 Vec3f gl::barycentric(Vec2f a, Vec2f b, Vec2f c, Vec2f p) {
@@ -59,49 +67,339 @@ Vec3f gl::barycentric(Vec2f a, Vec2f b, Vec2f c, Vec2f p) {
     return Vec3f(-1, -1, -1);
 }
 
-void gl::triangle(Matr<4, 3, float> &clip_coords, IShader &shader, QImage &image, float *zbuffer) {
-    Matr<3, 4, float> pts = (viewport * clip_coords).transpose();
+namespace {
+    /* Float depth is stored as it is */
+    class FloatDepth {
+    public:
+        FloatN operator()(FloatN depth) const {
+            return depth;
+        }
+    };
+
+    /* Depth in the fixed point steps of a DepthBuffer, whole numbers are exact in float lanes up to 24 bits */
+    class FixedDepth {
+    public:
+        FixedDepth(const gl::DepthBuffer &target): scale(target.scale()), one(1.0f), maximum(float(target.maximum())) {}
+        FloatN operator()(FloatN depth) const {
+            return trunc(min(max(depth * scale + one, one), maximum));
+        }
+    private:
+        FloatN scale, one, maximum;
+    };
+
+    /*
+     * Scan conversion with a depth test against zbuffer, which holds depth as encode() gives it. Fragments the
+     * shader keeps are handed to write(x, y, color, depth) with encoded depth, which decides what is stored.
+     */
+    template<typename Depth, typename Encode, typename Write>
+    void rasterize(const gl::RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, int width, int height,
+                   const Depth* zbuffer, Encode encode, Write write) {
+        Matr<3, 4, float> pts = (context.viewport * clip_coords).transpose();
+        Matr<3, 2, float> screen_coords;
+        for (size_t i = 0; i < 3; i++) screen_coords[i] = proj<2>(pts[i]);
+        Vec3f depths(pts[0][2] / pts[0][3], pts[1][2] / pts[1][3], pts[2][2] / pts[2][3]);
+        Vec3f w_inv(1.0f / pts[0][3], 1.0f / pts[1][3], 1.0f / pts[2][3]);
+
+        Vec2f bbmin(width - 1, height - 1), bbmax(0, 0);
+        Vec2f thresh = bbmin;
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 2; ++j) {
+                bbmin[j] = std::max(0.0f, std::min(bbmin[j], screen_coords[i][j]));
+                bbmax[j] = std::min(thresh[j], std::max(bbmax[j], screen_coords[i][j]));
+            }
+        }
+        Vec2i start(bbmin.x, bbmin.y), end(bbmax.x, bbmax.y);
+        GL_STATS_ADD(TRIANGLES_SUBMITTED, 1);
+        if (start.x > end.x || start.y > end.y) {
+            GL_STATS_ADD(TRIANGLES_CULLED, 1);
+            return;
+        }
+
+        /* Barycentrics are affine in screen space, so FloatN::WIDTH pixels of a row are tested at once */
+        Vec3f bc0 = gl::barycentric(screen_coords[0], screen_coords[1], screen_coords[2], start);
+        if (bc0.x == -1 && bc0.y == -1 && bc0.z == -1) {
+            GL_STATS_ADD(TRIANGLES_CULLED, 1);
+            return;
+        }
+        GL_STATS_ADD(TRIANGLES_RASTERIZED, 1);
+        Vec3f dx = gl::barycentric(screen_coords[0], screen_coords[1], screen_coords[2], start + Vec2i(1, 0)) - bc0;
+        Vec3f dy = gl::barycentric(screen_coords[0], screen_coords[1], screen_coords[2], start + Vec2i(0, 1)) - bc0;
+
+        const int W = FloatN::WIDTH;
+        const Vec3N<FloatN> step(Vec3f(dx * float(W)));
+        const Vec3N<FloatN> lane_w_inv(w_inv), lane_depths(depths);
+        const FloatN zero(0.0f);
+        float bc_lanes[3][W], z_lanes[W];
+        Depth depth_lanes[W];
+        Vec2i p;
+        QRgb color;
+        /* Rows outside the context are skipped, the rest is stepped from the same origin so bands match a whole pass */
+        for (p.y = std::max(start.y, context.top); p.y <= std::min(end.y, context.bottom); ++p.y) {
+            Vec3f bc_row = bc0 + dy * float(p.y - start.y);
+            Vec3N<FloatN> bc = Vec3N<FloatN>(bc_row) + Vec3N<FloatN>(dx) * FloatN::ramp();
+            const Depth* zrow = zbuffer + p.y * width;
+            for (p.x = start.x; p.x <= end.x; p.x += W, bc = bc + step) {
+                int tail = std::min(W, end.x - p.x + 1);
+                FloatN inside = (bc.x >= zero) & (bc.y >= zero) & (bc.z >= zero);
+                if (!(inside.mask() & ((1 << tail) - 1))) {
+                    continue;
+                }
+                Vec3N<FloatN> bc_clip(bc.x * lane_w_inv.x, bc.y * lane_w_inv.y, bc.z * lane_w_inv.z);
+                FloatN frag_depth = encode(dot(bc_clip, lane_depths) / (bc_clip.x + bc_clip.y + bc_clip.z));
+                /* Lanes past the end of the row compare against a copy so reads stay inside the buffer */
+                FloatN z;
+                if (tail == W) {
+                    z = FloatN::load(zrow + p.x);
+                } else {
+                    std::copy(zrow + p.x, zrow + p.x + tail, depth_lanes);
+                    z = FloatN::load(depth_lanes);
+                }
+                int mask = (inside & (z <= frag_depth)).mask() & ((1 << tail) - 1);
+                GL_STATS_ADD(PIXELS_TESTED, gl::Stats::bits(inside.mask() & ((1 << tail) - 1)));
+                GL_STATS_ADD(PIXELS_PASSED, gl::Stats::bits(mask));
+                if (!mask) {
+                    continue;
+                }
+                bc.x.store(bc_lanes[0]);
+                bc.y.store(bc_lanes[1]);
+                bc.z.store(bc_lanes[2]);
+                frag_depth.store(z_lanes);
+                for (int i = 0; i < tail; ++i) {
+                    if (!(mask & (1 << i))) {
+                        continue;
+                    }
+                    Vec3f bc_frag(bc_lanes[0][i] * w_inv.x, bc_lanes[1][i] * w_inv.y, bc_lanes[2][i] * w_inv.z);
+                    bc_frag = bc_frag / (bc_frag.x + bc_frag.y + bc_frag.z);
+                    shader.frag_coord = Vec2i(p.x + i, p.y);
+                    GL_STATS_ADD(FRAGMENTS_SHADED, 1);
+                    bool discard = shader.fragment(bc_frag, color);
+                    if (!discard) {
+                        write(p.x + i, p.y, color, z_lanes[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void gl::triangle(const RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, Framebuffer &target) {
+    QRgb* pixels = target.pixels;
+    float* zbuffer = target.zbuffer;
+    const int stride = target.stride, width = target.width;
+    rasterize(context, clip_coords, shader, width, target.height, zbuffer, FloatDepth(), [=](int x, int y, QRgb color, float depth) {
+        zbuffer[x + y * width] = depth;
+        pixels[x + y * stride] = color;
+    });
+}
+
+void gl::triangle(const RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, DepthBuffer &target) {
+    const int width = target.width(), height = target.height();
+    if (target.bits() == 16) {
+        quint16* zbuffer = target.shorts();
+        rasterize(context, clip_coords, shader, width, height, zbuffer, FixedDepth(target), [=](int x, int y, QRgb, float depth) {
+            zbuffer[x + y * width] = depth;
+        });
+    } else if (target.bits() == 24) {
+        quint32* zbuffer = target.words();
+        rasterize(context, clip_coords, shader, width, height, zbuffer, FixedDepth(target), [=](int x, int y, QRgb, float depth) {
+            zbuffer[x + y * width] = depth;
+        });
+    } else {
+        float* zbuffer = target.floats();
+        rasterize(context, clip_coords, shader, width, height, zbuffer, FloatDepth(), [=](int x, int y, QRgb, float depth) {
+            zbuffer[x + y * width] = depth;
+        });
+    }
+}
+
+void gl::triangle(const RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, BlendBuffer &target,
+                  const float* zbuffer) {
+    rasterize(context, clip_coords, shader, target.width(), target.height(), zbuffer, FloatDepth(), [&](int x, int y, QRgb color, float depth) {
+        target.add(x, y, color, depth / DEPTH);
+    });
+}
+
+void gl::triangle(const RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, MultisampleBuffer &target) {
+    Matr<3, 4, float> pts = (context.viewport * clip_coords).transpose();
     Matr<3, 2, float> screen_coords;
     for (size_t i = 0; i < 3; i++) screen_coords[i] = proj<2>(pts[i]);
+    Vec3f depths(pts[0][2] / pts[0][3], pts[1][2] / pts[1][3], pts[2][2] / pts[2][3]);
+    Vec3f w_inv(1.0f / pts[0][3], 1.0f / pts[1][3], 1.0f / pts[2][3]);
 
-    Vec2f bbmin(image.width() - 1, image.height() - 1), bbmax(0, 0);
+    /* Samples lie within half a pixel of the pixel position */
+    Vec2f bbmin(target.width() - 1, target.height() - 1), bbmax(0, 0);
     Vec2f thresh = bbmin;
     for (size_t i = 0; i < 3; ++i) {
         for (size_t j = 0; j < 2; ++j) {
-            bbmin[j] = std::max(0.0f, std::min(bbmin[j], screen_coords[i][j]));
-            bbmax[j] = std::min(thresh[j], std::max(bbmax[j], screen_coords[i][j]));
+            bbmin[j] = std::max(0.0f, std::min(bbmin[j], std::floor(screen_coords[i][j] - 0.5f)));
+            bbmax[j] = std::min(thresh[j], std::max(bbmax[j], std::ceil(screen_coords[i][j] + 0.5f)));
         }
     }
+
+    /* Screen-space barycentrics are affine: bc(p) = bc0 + dx * (p.x - bbmin.x) + dy * (p.y - bbmin.y) */
+    Vec3f bc0 = barycentric(screen_coords[0], screen_coords[1], screen_coords[2], bbmin);
+    GL_STATS_ADD(TRIANGLES_SUBMITTED, 1);
+    if (bbmin.x > bbmax.x || bbmin.y > bbmax.y || (bc0.x == -1 && bc0.y == -1 && bc0.z == -1)) {
+        GL_STATS_ADD(TRIANGLES_CULLED, 1);
+        return;
+    }
+    GL_STATS_ADD(TRIANGLES_RASTERIZED, 1);
+    Vec3f dx = barycentric(screen_coords[0], screen_coords[1], screen_coords[2], bbmin + Vec2f(1, 0)) - bc0;
+    Vec3f dy = barycentric(screen_coords[0], screen_coords[1], screen_coords[2], bbmin + Vec2f(0, 1)) - bc0;
+
+    const int n = target.samples();
+    const Vec2f* pattern = target.pattern();
+    Vec3f sample_bc[MultisampleBuffer::MAX_SAMPLES];
+    float sample_depth[MultisampleBuffer::MAX_SAMPLES];
     Vec2i p;
     QRgb color;
     for (p.x = bbmin.x; p.x <= bbmax.x; ++p.x) {
-        for (p.y = bbmin.y; p.y <= bbmax.y; ++p.y) {
-            Vec3f bc_screen = barycentric(screen_coords[0], screen_coords[1], screen_coords[2], p);
-            Vec3f bc_clip = Vec3f(bc_screen.x / pts[0][3], bc_screen.y / pts[1][3], bc_screen.z / pts[2][3]);
-            bc_clip = bc_clip / (bc_clip.x + bc_clip.y + bc_clip.z);
-            float frag_depth = bc_clip * Vec3f(pts[0][2] / pts[0][3], pts[1][2] / pts[1][3], pts[2][2] / pts[2][3]);
-            if (bc_screen.x < 0 || bc_screen.y < 0 || bc_screen.z < 0 || zbuffer[p.x + p.y * image.width()] > frag_depth) {
+        for (p.y = std::max<int>(bbmin.y, context.top); p.y <= std::min<int>(bbmax.y, context.bottom); ++p.y) {
+            Vec3f bc_pixel = bc0 + dx * (p.x - bbmin.x) + dy * (p.y - bbmin.y);
+            float* zbuf = target.depth(p.x, p.y);
+            int mask = 0;
+            for (int s = 0; s < n; ++s) {
+                Vec3f bc_screen = bc_pixel + dx * pattern[s].x + dy * pattern[s].y;
+                if (bc_screen.x < 0 || bc_screen.y < 0 || bc_screen.z < 0) {
+                    continue;
+                }
+                GL_STATS_ADD(PIXELS_TESTED, 1);
+                Vec3f bc_clip = Vec3f(bc_screen.x * w_inv.x, bc_screen.y * w_inv.y, bc_screen.z * w_inv.z);
+                bc_clip = bc_clip / (bc_clip.x + bc_clip.y + bc_clip.z);
+                sample_depth[s] = bc_clip * depths;
+                if (zbuf[s] > sample_depth[s]) {
+                    continue;
+                }
+                GL_STATS_ADD(PIXELS_PASSED, 1);
+                sample_bc[s] = bc_screen;
+                mask |= 1 << s;
+            }
+            if (!mask) {
                 continue;
             }
+            /* Shade at the pixel position if it is covered, otherwise at the first covered sample */
+            Vec3f bc_screen = bc_pixel;
+            if (bc_screen.x < 0 || bc_screen.y < 0 || bc_screen.z < 0) {
+                for (int s = 0; s < n; ++s) {
+                    if (mask & (1 << s)) {
+                        bc_screen = sample_bc[s];
+                        break;
+                    }
+                }
+            }
+            Vec3f bc_clip = Vec3f(bc_screen.x * w_inv.x, bc_screen.y * w_inv.y, bc_screen.z * w_inv.z);
+            bc_clip = bc_clip / (bc_clip.x + bc_clip.y + bc_clip.z);
+            shader.frag_coord = p;
+            GL_STATS_ADD(FRAGMENTS_SHADED, 1);
             bool discard = shader.fragment(bc_clip, color);
-            if (!discard) {
-                zbuffer[p.x + p.y * image.width()] = frag_depth;
-                image.setPixel(QPoint(p.x, p.y), color);
+            if (discard) {
+                continue;
+            }
+            QRgb* cbuf = target.color(p.x, p.y);
+            for (int s = 0; s < n; ++s) {
+                if (mask & (1 << s)) {
+                    zbuf[s] = sample_depth[s];
+                    cbuf[s] = color;
+                }
             }
         }
     }
 }
 
-QImage gl::diff(const QImage &img1, const QImage &img2) {
-    assert(img1.width() == img2.width());
-    assert(img1.height() == img2.height());
-    QImage res(img1.width(), img1.height(), QImage::Format_RGB32);
-    for (int x = 0; x < img1.width(); ++x) {
-        for (int y = 0; y < img1.height(); ++y) {
-            QRgb a = img1.pixel(x, y);
-            QRgb b = img2.pixel(x, y);
-            res.setPixel(QPoint(x, y), qRgb(std::abs(qRed(a) - qRed(b)), std::abs(qGreen(a) - qGreen(b)), std::abs(qBlue(a) - qBlue(b))));
+ImageDiff::ImageDiff(): pixels(0), mismatched(0), max_error(0), mean_error(0), psnr(std::numeric_limits<double>::infinity()) {}
+
+namespace {
+    /* Sums of a row, or of the whole image once finished */
+    class DiffSums {
+    public:
+        DiffSums(): abs_sum(0), sq_sum(0), max_error(0), mismatched(0) {}
+        qint64 abs_sum, sq_sum;
+        int max_error, mismatched;
+    };
+
+    void diffPixels(const QRgb* a, const QRgb* b, QRgb* out, int n, int threshold, DiffSums &sums) {
+        for (int i = 0; i < n; ++i) {
+            int d[3] = {std::abs(qRed(a[i]) - qRed(b[i])), std::abs(qGreen(a[i]) - qGreen(b[i])), std::abs(qBlue(a[i]) - qBlue(b[i]))};
+            bool mismatch = false;
+            for (int c = 0; c < 3; ++c) {
+                sums.abs_sum += d[c];
+                sums.sq_sum += d[c] * d[c];
+                sums.max_error = std::max(sums.max_error, d[c]);
+                mismatch |= d[c] > threshold;
+            }
+            sums.mismatched += mismatch;
+            if (out) {
+                out[i] = qRgb(d[0], d[1], d[2]);
+            }
+        }
+    }
+
+    ImageDiff compareImages(const QImage &img1, const QImage &img2, int threshold, QImage* out) {
+        assert(img1.width() == img2.width());
+        assert(img1.height() == img2.height());
+        QImage a = img1.convertToFormat(QImage::Format_RGB32), b = img2.convertToFormat(QImage::Format_RGB32);
+        int w = a.width();
+        DiffSums total;
+        for (int y = 0; y < a.height(); ++y) {
+            const QRgb* row_a = (const QRgb*)a.constScanLine(y);
+            const QRgb* row_b = (const QRgb*)b.constScanLine(y);
+            QRgb* row_out = out ? (QRgb*)out->scanLine(y) : NULL;
+            int x = 0;
+#ifdef GEOMETRY_SSE
+            /* Four pixels at a time: saturated differences both ways give the absolute difference per byte */
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i rgb = _mm_set1_epi32(0x00ffffff), alpha = _mm_set1_epi32(0xff000000);
+            const __m128i thresh = _mm_and_si128(_mm_set1_epi8((char)std::min(255, std::max(0, threshold))), rgb);
+            __m128i abs_sum = zero, sq_sum = zero, max_error = zero;
+            int mismatched = 0;
+            for (; x + 4 <= w; x += 4) {
+                __m128i pa = _mm_loadu_si128((const __m128i*)(row_a + x));
+                __m128i pb = _mm_loadu_si128((const __m128i*)(row_b + x));
+                __m128i d = _mm_and_si128(_mm_or_si128(_mm_subs_epu8(pa, pb), _mm_subs_epu8(pb, pa)), rgb);
+                abs_sum = _mm_add_epi64(abs_sum, _mm_sad_epu8(d, zero));
+                __m128i lo = _mm_unpacklo_epi8(d, zero), hi = _mm_unpackhi_epi8(d, zero);
+                sq_sum = _mm_add_epi32(sq_sum, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+                max_error = _mm_max_epu8(max_error, d);
+                __m128i over = _mm_subs_epu8(d, thresh);
+                mismatched += 4 - gl::Stats::bits(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(over, zero))));
+                if (row_out) {
+                    _mm_storeu_si128((__m128i*)(row_out + x), _mm_or_si128(d, alpha));
+                }
+            }
+            qint64 lanes[2];
+            _mm_storeu_si128((__m128i*)lanes, abs_sum);
+            total.abs_sum += lanes[0] + lanes[1];
+            int sq[4];
+            _mm_storeu_si128((__m128i*)sq, sq_sum);
+            total.sq_sum += qint64(sq[0]) + sq[1] + sq[2] + sq[3];
+            unsigned char bytes[16];
+            _mm_storeu_si128((__m128i*)bytes, max_error);
+            total.max_error = std::max<int>(total.max_error, *std::max_element(bytes, bytes + 16));
+            total.mismatched += mismatched;
+#endif
+            diffPixels(row_a + x, row_b + x, row_out ? row_out + x : NULL, w - x, threshold, total);
+        }
+        ImageDiff res;
+        res.pixels = w * a.height();
+        res.mismatched = total.mismatched;
+        res.max_error = total.max_error;
+        if (res.pixels) {
+            res.mean_error = double(total.abs_sum) / (3.0 * res.pixels);
+            double mse = double(total.sq_sum) / (3.0 * res.pixels);
+            if (mse > 0) {
+                res.psnr = 10 * std::log10(255.0 * 255.0 / mse);
+            }
         }
+        return res;
     }
+}
+
+ImageDiff gl::compare(const QImage &img1, const QImage &img2, int threshold) {
+    return compareImages(img1, img2, threshold, NULL);
+}
+
+QImage gl::diff(const QImage &img1, const QImage &img2) {
+    QImage res(img1.width(), img1.height(), QImage::Format_RGB32);
+    compareImages(img1, img2, 0, &res);
     return res;
 }
\ No newline at end of file
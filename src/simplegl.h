@@ -3,25 +3,73 @@
 #include <QImage>
 
 #include "geometry.h"
+#include "multisample.h"
+#include "blend.h"
+#include "arena.h"
+#include "framebuffer.h"
+
+/* Per-channel differences of two images, alpha is ignored */
+class ImageDiff {
+public:
+    ImageDiff();
+    int pixels;
+    /* Pixels with a channel off by more than the comparison threshold */
+    int mismatched;
+    int max_error;
+    double mean_error;
+    /* Peak signal-to-noise ratio in dB, infinite for equal images */
+    double psnr;
+};
+
+class Model;
 
 class IShader {
 public:
 	virtual ~IShader() {};
     virtual Vec4f vertex(int iface, int nthvert) = 0;
     virtual bool fragment(Vec3f bar, QRgb &color) = 0;
+    /* Called before the faces of each instance are drawn */
+    virtual void bindInstance(const Matrix &) {}
+
+    /* Window coordinates of the fragment being shaded, set by gl::triangle */
+    Vec2i frag_coord;
 };
 
 namespace gl {
-    void lookat(const Vec3f &eye, const Vec3f &center, const Vec3f &up);
+    /*
+     * Pipeline state of a pass and the draw in progress. Every pass has its own,
+     * so any number of passes and renderers can run at the same time.
+     */
+    class RenderContext {
+    public:
+        RenderContext(const Matrix &viewport, const Matrix &projection, const Matrix &modelview, Arena* arena);
+
+        Matrix viewport, projection, modelview;
+        /* Scratch memory of the frame for the shaders and per-pass tables */
+        Arena* arena;
+        /* Set before the faces of a model instance are drawn */
+        const Model* model;
+        Matrix transform;
+        /* Rows drawn to, first and last; every row by default */
+        int top, bottom;
+    };
+
     Matrix rotate(const Vec3f &eye, const Vec3f &center, const Vec3f &up);
-    void set_viewport(int x, int y, int w, int h);
-    void set_projection(float coeff);
+    Matrix lookat_matrix(const Vec3f &eye, const Vec3f &center, const Vec3f &up);
+    /* (x, y) is the top left corner in image rows, which go downwards */
+    Matrix viewport_matrix(int x, int y, int w, int h);
+    Matrix projection_matrix(float coeff);
     Vec3f barycentric(Vec2f a, Vec2f b, Vec2f c, Vec2f p);
-    void triangle(Matr<4, 3, float> &clip_coords, IShader &shader, QImage &image, float* zbuffer);
+    void triangle(const RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, Framebuffer &target);
+    /* Only depth is written, the fragment shader still decides what is kept */
+    void triangle(const RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, DepthBuffer &target);
+    /* Coverage and depth are tested per sample, the fragment shader runs once per pixel */
+    void triangle(const RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, MultisampleBuffer &target);
+    /* Fragments in front of the depth buffer are accumulated without writing depth */
+    void triangle(const RenderContext &context, Matr<4, 3, float> &clip_coords, IShader &shader, BlendBuffer &target,
+                  const float* zbuffer);
 	QImage diff(const QImage &img1, const QImage &img2);
+    ImageDiff compare(const QImage &img1, const QImage &img2, int threshold = 0);
 
-	extern Matrix viewport;
-	extern Matrix projection;
-	extern Matrix modelview;
 	extern int const DEPTH;
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "ssao.h"
+
+namespace {
+    const float BACKGROUND = -std::numeric_limits<float>::max();
+}
+
+gl::AmbientOcclusion::AmbientOcclusion(int width, int height)
+        : w(width), h(height), hw((width + 1) / 2), hh((height + 1) / 2), radius(std::max(2, height / 80)) {
+    stride = hw + 2 * radius + FloatN::WIDTH;
+    depth.fill(BACKGROUND, (hh + 2 * radius) * stride);
+    occlusion.fill(1.0f, hh * stride);
+    /* A spiral filling half of the disc evenly, closer samples first; the pairs mirror it */
+    float pi = acos(-1.0);
+    float golden_angle = pi * (3 - std::sqrt(5.0f)) / 2;
+    for (int i = 0; i < PAIRS; ++i) {
+        float r = radius * std::sqrt((i + 0.5f) / PAIRS), a = i * golden_angle;
+        int dx = std::floor(r * std::cos(a) + 0.5f), dy = std::floor(r * std::sin(a) + 0.5f);
+        if (!dx && !dy) {
+            dx = 1;
+        }
+        offsets[i] = dx + dy * stride;
+        distances[i] = std::sqrt(float(dx * dx + dy * dy));
+    }
+}
+
+int gl::AmbientOcclusion::halfBands() const {
+    return (hh + BAND - 1) / BAND;
+}
+
+int gl::AmbientOcclusion::fullBands() const {
+    return (h + BAND - 1) / BAND;
+}
+
+void gl::AmbientOcclusion::downsample(int band, const float* zbuffer, float depth_scale) {
+    /* The nearest of four, so thin foreground stays in the half resolution depth */
+    float scale = depth_scale / 2;
+    for (int y = band * BAND; y < std::min(hh, (band + 1) * BAND); ++y) {
+        float* dst = depth.data() + (y + radius) * stride + radius;
+        const float* row0 = zbuffer + 2 * y * w;
+        const float* row1 = zbuffer + std::min(2 * y + 1, h - 1) * w;
+        for (int x = 0; x < hw; ++x) {
+            int x0 = 2 * x, x1 = std::min(2 * x + 1, w - 1);
+            float z = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+            dst[x] = z == BACKGROUND ? BACKGROUND : z * scale;
+        }
+    }
+}
+
+void gl::AmbientOcclusion::occlude(int band, float strength) {
+    /*
+     * A pair of neighbours whose middle rises h pixels above the pixel at distance d occludes h / (h + d), which
+     * grows with the elevation angle. Taking the middle keeps slopes from shadowing themselves, only creases
+     * rise. Rises beyond the radius belong to other objects and fade out instead of casting halos.
+     */
+    const int W = FloatN::WIDTH;
+    const FloatN zero(0.0f), one(1.0f), half(0.5f), bias(0.25f), range((float)radius), inv_range(1.0f / radius);
+    const FloatN scale(3.0f * strength / PAIRS);
+    for (int y = band * BAND; y < std::min(hh, (band + 1) * BAND); ++y) {
+        const float* row = depth.data() + (y + radius) * stride + radius;
+        float* dst = occlusion.data() + y * stride;
+        for (int x = 0; x < hw; x += W) {
+            FloatN z = FloatN::load(row + x), sum(0.0f);
+            for (int s = 0; s < PAIRS; ++s) {
+                FloatN middle = (FloatN::load(row + x + offsets[s]) + FloatN::load(row + x - offsets[s])) * half;
+                FloatN rise = min(max(middle - z - bias, zero), range);
+                sum = sum + rise / (rise + FloatN(distances[s])) * (one - rise * inv_range);
+            }
+            max(one - sum * scale, zero).store(dst + x);
+        }
+    }
+}
+
+void gl::AmbientOcclusion::upsample(int band, QRgb* pixels, int image_stride, const float* zbuffer, float depth_scale) const {
+    float scale = depth_scale / 2;
+    for (int y = band * BAND; y < std::min(h, (band + 1) * BAND); ++y) {
+        QRgb* line = pixels + y * image_stride;
+        const float* zrow = zbuffer + y * w;
+        float hy = y * 0.5f - 0.25f;
+        int y0 = std::floor(hy);
+        float fy = hy - y0;
+        int ys[2] = {std::max(0, y0), std::min(hh - 1, y0 + 1)};
+        for (int x = 0; x < w; ++x) {
+            if (zrow[x] == BACKGROUND) {
+                continue;
+            }
+            float z = zrow[x] * scale;
+            float hx = x * 0.5f - 0.25f;
+            int x0 = std::floor(hx);
+            float fx = hx - x0;
+            int xs[2] = {std::max(0, x0), std::min(hw - 1, x0 + 1)};
+            /* Bilinear weights scaled down by depth difference, taps on another surface hardly count */
+            float total = 0, weight_sum = 0;
+            for (int j = 0; j < 2; ++j) {
+                for (int i = 0; i < 2; ++i) {
+                    float bilinear = (i ? fx : 1 - fx) * (j ? fy : 1 - fy) + 1e-3f;
+                    float dz = std::abs(z - depth[(ys[j] + radius) * stride + xs[i] + radius]);
+                    float weight = bilinear / (1e-2f + dz);
+                    total += weight * occlusion[ys[j] * stride + xs[i]];
+                    weight_sum += weight;
+                }
+            }
+            float ao = total / weight_sum;
+            QRgb c = line[x];
+            line[x] = qRgb(qRed(c) * ao + 0.5f, qGreen(c) * ao + 0.5f, qBlue(c) * ao + 0.5f);
+        }
+    }
+}
\ No newline at end of file
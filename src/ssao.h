@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QImage>
+#include <QVector>
+
+#include "geometry.h"
+
+namespace gl {
+    /*
+     * Screen-space ambient occlusion from the depth buffer alone. Occlusion is estimated at half resolution
+     * from how far pairs of neighbours of a pixel rise above it, then upsampled with weights that follow depth,
+     * so dark halos do not bleed across silhouettes. Each of the three steps is split into bands of rows that
+     * can run in parallel, a step reads the rows of its neighbours, so it starts once the previous one is done.
+     */
+    class AmbientOcclusion {
+    public:
+        AmbientOcclusion(int width, int height);
+
+        /* Bands of the half resolution steps and of upsample() */
+        int halfBands() const;
+        int fullBands() const;
+        /* depth_scale converts depth buffer units to pixels */
+        void downsample(int band, const float* zbuffer, float depth_scale);
+        void occlude(int band, float strength);
+        /* Darkens by up to the strength given to occlude() the band of an image whose rows are stride pixels apart */
+        void upsample(int band, QRgb* pixels, int stride, const float* zbuffer, float depth_scale) const;
+    private:
+        /* Samples come in pairs opposite each other */
+        static const int PAIRS = 8;
+        static const int BAND = 16;
+
+        int w, h, hw, hh;
+        /* Sampling radius in half resolution pixels, the half resolution depth has a border that wide */
+        int radius, stride;
+        int offsets[PAIRS];
+        float distances[PAIRS];
+        /* Half resolution depth in half resolution pixels, nearer is larger */
+        QVector<float> depth;
+        QVector<float> occlusion;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QAtomicInteger>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <limits>
+#include <iostream>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+
+#include "stats.h"
+
+gl::Stats gl::stats;
+
+namespace {
+    const char* COUNTER_NAMES[] = {
+        "triangles submitted", "triangles culled", "triangles rasterized",
+        "pixels tested", "pixels passed", "fragments shaded", "pixels covered", "allocations"
+    };
+}
+
+#ifdef RENDERER_STATS
+namespace {
+    QAtomicInteger<qint64> allocation_count;
+    /* Plain data, counting it cannot allocate */
+    thread_local qint64 thread_allocation_count;
+}
+
+#ifdef __GLIBC__
+/* Qt containers and images allocate with malloc, so count there rather than in operator new */
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t n, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+
+    void* malloc(size_t size) {
+        allocation_count.fetchAndAddRelaxed(1);
+        ++thread_allocation_count;
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t n, size_t size) {
+        allocation_count.fetchAndAddRelaxed(1);
+        ++thread_allocation_count;
+        return __libc_calloc(n, size);
+    }
+
+    void* realloc(void* ptr, size_t size) {
+        allocation_count.fetchAndAddRelaxed(1);
+        ++thread_allocation_count;
+        return __libc_realloc(ptr, size);
+    }
+
+    void* memalign(size_t alignment, size_t size) {
+        allocation_count.fetchAndAddRelaxed(1);
+        ++thread_allocation_count;
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) {
+        return memalign(alignment, size);
+    }
+
+    int posix_memalign(void** res, size_t alignment, size_t size) {
+        if (!alignment || (alignment & (alignment - 1)) || alignment % sizeof(void*)) {
+            return EINVAL;
+        }
+        void* ptr = memalign(alignment, size);
+        if (!ptr) {
+            return ENOMEM;
+        }
+        *res = ptr;
+        return 0;
+    }
+}
+#else
+void* operator new(size_t size) {
+    allocation_count.fetchAndAddRelaxed(1);
+    ++thread_allocation_count;
+    if (void* res = std::malloc(size ? size : 1)) {
+        return res;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+#endif
+#endif
+
+namespace {
+    /* Heap allocations made by the calling thread so far */
+    qint64 threadAllocations() {
+#ifdef RENDERER_STATS
+        return thread_allocation_count;
+#else
+        return 0;
+#endif
+    }
+}
+
+thread_local gl::Stats::Band gl::Stats::band;
+
+const char* gl::Stats::counterName(int counter) {
+    return COUNTER_NAMES[counter];
+}
+
+gl::Stats::Pass::Pass(): frame(0), track(0), start(0), duration(0) {
+    std::fill(counters, counters + NCOUNTERS, 0);
+}
+
+float gl::Stats::Pass::overdraw() const {
+    return counters[PIXELS_COVERED] ? float(counters[FRAGMENTS_SHADED]) / counters[PIXELS_COVERED] : 0.0f;
+}
+
+gl::Stats::Stats(): frames(0) {
+    clock.start();
+}
+
+bool gl::Stats::enabled() {
+#ifdef RENDERER_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 gl::Stats::allocations() {
+#ifdef RENDERER_STATS
+    return allocation_count.load();
+#else
+    return 0;
+#endif
+}
+
+int gl::Stats::beginFrame() {
+    QMutexLocker lock(&mutex);
+    int frame = frames++;
+    Pass pass;
+    pass.name = "frame";
+    pass.frame = frame;
+    pass.start = clock.nsecsElapsed();
+    open[frame].push_back(pass);
+    /* Last, so the bookkeeping is not counted */
+    qint64 &before = open_allocations[frame];
+    before = allocations();
+    return frame;
+}
+
+void gl::Stats::endFrame(int frame) {
+    qint64 allocated = allocations();
+    QMutexLocker lock(&mutex);
+    QVector<Pass> passes = open.take(frame);
+    passes[0].counters[ALLOCATIONS] += allocated - open_allocations.take(frame);
+    passes[0].duration = clock.nsecsElapsed() - passes[0].start;
+    last = passes;
+    for (int i = 0; i < passes.size(); ++i) {
+        if (history.size() >= MAX_HISTORY) {
+            history.remove(0, MAX_HISTORY / 2);
+        }
+        history.push_back(passes[i]);
+    }
+}
+
+int gl::Stats::addPass(int frame, const char* name) {
+    qint64 before = threadAllocations();
+    QMutexLocker lock(&mutex);
+    QVector<Pass> &passes = open[frame];
+    Pass pass;
+    pass.name = name;
+    pass.frame = frame;
+    pass.track = passes.size();
+    /* Not started until a band is */
+    pass.start = -1;
+    passes.push_back(pass);
+    /* The frame does not count what adding its passes allocates */
+    passes[0].counters[ALLOCATIONS] -= threadAllocations() - before;
+    return passes.size() - 1;
+}
+
+void gl::Stats::beginBand(int frame, int pass) {
+    band.frame = frame;
+    band.pass = pass;
+    std::fill(band.counters, band.counters + NCOUNTERS, 0);
+    band.start = clock.nsecsElapsed();
+    /* Last, so only what the band itself allocates is counted */
+    band.allocations = threadAllocations();
+}
+
+void gl::Stats::endBand() {
+    band.counters[ALLOCATIONS] += threadAllocations() - band.allocations;
+    qint64 end = clock.nsecsElapsed();
+    QMutexLocker lock(&mutex);
+    Pass &pass = open[band.frame][band.pass];
+    for (int c = 0; c < NCOUNTERS; ++c) {
+        pass.counters[c] += band.counters[c];
+    }
+    end = std::max(end, pass.start + pass.duration);
+    pass.start = pass.start < 0 ? band.start : std::min(pass.start, band.start);
+    pass.duration = end - pass.start;
+}
+
+QVector<gl::Stats::Pass> gl::Stats::lastFrame() const {
+    QMutexLocker lock(&mutex);
+    return last;
+}
+
+QString gl::Stats::summary() const {
+    QMutexLocker lock(&mutex);
+    QString res;
+    for (int i = 0; i < last.size(); ++i) {
+        const Pass &p = last[i];
+        res += QString("%1: %2 ms, %3/%4 triangles rasterized, %5/%6 pixels passed depth, %7 shaded, overdraw %8, %9 allocations\n")
+                .arg(p.name).arg(p.duration / 1e6, 0, 'f', 2)
+                .arg(p.counters[TRIANGLES_RASTERIZED]).arg(p.counters[TRIANGLES_SUBMITTED])
+                .arg(p.counters[PIXELS_PASSED]).arg(p.counters[PIXELS_TESTED])
+                .arg(p.counters[FRAGMENTS_SHADED]).arg(p.overdraw(), 0, 'f', 2)
+                .arg(p.counters[ALLOCATIONS]);
+    }
+    return res;
+}
+
+bool gl::Stats::writeTrace(const QString &filename) const {
+    QMutexLocker lock(&mutex);
+    QJsonArray events;
+    for (int i = 0; i < history.size(); ++i) {
+        const Pass &p = history[i];
+        QJsonObject args;
+        args["frame"] = p.frame;
+        for (int c = 0; c < NCOUNTERS; ++c) {
+            args[counterName(c)] = double(p.counters[c]);
+        }
+        args["overdraw"] = p.overdraw();
+        QJsonObject event;
+        event["name"] = p.name;
+        event["ph"] = QString("X");
+        event["ts"] = p.start / 1e3;
+        event["dur"] = p.duration / 1e3;
+        event["pid"] = 1;
+        event["tid"] = p.track + 1;
+        event["args"] = args;
+        events.append(event);
+    }
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    trace["displayTimeUnit"] = QString("ms");
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        std::cerr << "can't write " << filename.toStdString() << "\n";
+        return false;
+    }
+    file.write(QJsonDocument(trace).toJson());
+    return true;
+}
+
+qint64 gl::Stats::covered(const float* zbuffer, int size) {
+    qint64 res = 0;
+    for (int i = 0; i < size; ++i) {
+        res += zbuffer[i] != -std::numeric_limits<float>::max();
+    }
+    return res;
+}
\ No newline at end of file
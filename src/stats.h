@@ -0,0 +1,114 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+
+namespace gl {
+    /*
+     * Pipeline counters and wall time of every pass. Collected only when built with RENDERER_STATS
+     * (qmake CONFIG+=stats), otherwise the GL_STATS macros below expand to nothing. A pass is drawn in
+     * bands on any number of threads, each counts into its own thread and adds up when the band ends;
+     * frames of several renderers may be drawn at the same time.
+     */
+    class Stats {
+    public:
+        enum Counter {
+            TRIANGLES_SUBMITTED, TRIANGLES_CULLED, TRIANGLES_RASTERIZED,
+            PIXELS_TESTED, PIXELS_PASSED, FRAGMENTS_SHADED, PIXELS_COVERED, ALLOCATIONS, NCOUNTERS
+        };
+        static const char* counterName(int counter);
+
+        class Pass {
+        public:
+            Pass();
+            /* Shaded fragments per covered pixel */
+            float overdraw() const;
+
+            QString name;
+            int frame;
+            /* Row of the trace, passes of a frame overlap */
+            int track;
+            /* Nanoseconds since the statistics were created, from the first band to the end of the last */
+            qint64 start, duration;
+            qint64 counters[NCOUNTERS];
+        };
+
+        /* Passes kept for the trace, older ones are dropped */
+        static const int MAX_HISTORY = 4096;
+
+        Stats();
+        static bool enabled();
+        /*
+         * Heap allocations made by the whole process so far, counted only in builds with statistics. With glibc
+         * malloc, calloc, realloc and the aligned variants are counted, elsewhere only operator new.
+         */
+        static qint64 allocations();
+
+        /*
+         * Returns the number of a new frame. Its first entry is the frame itself, with every heap allocation the
+         * process made meanwhile, also those outside the bands.
+         */
+        int beginFrame();
+        /* The passes of the frame become the last frame */
+        void endFrame(int frame);
+        /* Returns the number of a pass of the frame, its bands are counted between beginBand() and endBand() */
+        int addPass(int frame, const char* name);
+        void beginBand(int frame, int pass);
+        void endBand();
+        void add(Counter counter, qint64 n) {
+            band.counters[counter] += n;
+        }
+
+        /* Passes of the last complete frame */
+        QVector<Pass> lastFrame() const;
+        QString summary() const;
+        /* Chrome trace event format, open in chrome://tracing or Perfetto */
+        bool writeTrace(const QString &filename) const;
+
+        static int bits(int mask) {
+            int res = 0;
+            for (; mask; mask &= mask - 1, ++res);
+            return res;
+        }
+        /* Pixels of a depth buffer that something was drawn to */
+        static qint64 covered(const float* zbuffer, int size);
+    private:
+        /* Plain data, so every thread has one without constructing it */
+        class Band {
+        public:
+            int frame, pass;
+            qint64 start, allocations;
+            qint64 counters[NCOUNTERS];
+        };
+
+        static thread_local Band band;
+        QElapsedTimer clock;
+        mutable QMutex mutex;
+        int frames;
+        /* Frames being drawn and the allocation count when they started */
+        QHash<int, QVector<Pass> > open;
+        QHash<int, qint64> open_allocations;
+        QVector<Pass> last, history;
+    };
+
+    extern Stats stats;
+}
+
+#ifdef RENDERER_STATS
+#define GL_STATS_ADD(counter, n) gl::stats.add(gl::Stats::counter, (n))
+#define GL_STATS_BEGIN_FRAME() gl::stats.beginFrame()
+#define GL_STATS_END_FRAME(frame) gl::stats.endFrame(frame)
+#define GL_STATS_ADD_PASS(frame, name) gl::stats.addPass((frame), (name))
+#define GL_STATS_BEGIN_BAND(frame, pass) gl::stats.beginBand((frame), (pass))
+#define GL_STATS_END_BAND() gl::stats.endBand()
+#else
+#define GL_STATS_ADD(counter, n) ((void)0)
+#define GL_STATS_BEGIN_FRAME() 0
+#define GL_STATS_END_FRAME(frame) ((void)0)
+#define GL_STATS_ADD_PASS(frame, name) 0
+#define GL_STATS_BEGIN_BAND(frame, pass) ((void)0)
+#define GL_STATS_END_BAND() ((void)0)
+#endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <QThreadPool>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+#include "taskgraph.h"
+
+gl::TaskGraph::TaskGraph(Arena* arena): arena(arena), first(NULL), last(NULL), ready(NULL), ready_last(NULL), remaining(0),
+                                         running(0) {}
+
+gl::TaskGraph::~TaskGraph() {
+    for (int i = 0; i < helpers.size(); ++i) {
+        delete helpers[i];
+    }
+}
+
+gl::TaskGraph::Helper::Helper(TaskGraph* graph): graph(graph) {
+    setAutoDelete(false);
+}
+
+void gl::TaskGraph::Helper::run() {
+    graph->work();
+    QMutexLocker lock(&graph->mutex);
+    if (!--graph->running) {
+        graph->finished.wakeAll();
+    }
+}
+
+void gl::TaskGraph::clear() {
+    first = last = NULL;
+}
+
+void gl::TaskGraph::append(Task* task) {
+    task->pending = 0;
+    task->dependents = task->last_dependent = NULL;
+    task->next = NULL;
+    (last ? last->next : first) = task;
+    last = task;
+}
+
+void gl::TaskGraph::depend(Task* task, Task* dependency) {
+    Task::Edge* edge = arena->alloc<Task::Edge>(1);
+    edge->task = task;
+    edge->next = NULL;
+    (dependency->last_dependent ? dependency->last_dependent->next : dependency->dependents) = edge;
+    dependency->last_dependent = edge;
+    ++task->pending;
+}
+
+void gl::TaskGraph::push(Task* task) {
+    task->next_ready = NULL;
+    (ready_last ? ready_last->next_ready : ready) = task;
+    ready_last = task;
+}
+
+void gl::TaskGraph::run() {
+    ready = ready_last = NULL;
+    remaining = 0;
+    for (Task* task = first; task; task = task->next) {
+        ++remaining;
+        if (!task->pending) {
+            push(task);
+        }
+    }
+    QThreadPool* pool = QThreadPool::globalInstance();
+    int nhelpers = std::min(remaining, pool->maxThreadCount()) - 1;
+    while (helpers.size() < nhelpers) {
+        helpers.push_back(new Helper(this));
+    }
+    /* Helpers change remaining as soon as they start */
+    running = std::max(0, nhelpers);
+    for (int i = 0; i < nhelpers; ++i) {
+        pool->start(helpers[i]);
+    }
+    work();
+    for (int i = 0; i < nhelpers; ++i) {
+        if (pool->tryTake(helpers[i])) {
+            QMutexLocker lock(&mutex);
+            --running;
+        }
+    }
+    QMutexLocker lock(&mutex);
+    while (running) {
+        finished.wait(&mutex);
+    }
+}
+
+void gl::TaskGraph::work() {
+    QMutexLocker lock(&mutex);
+    while (remaining) {
+        if (!ready) {
+            wakeup.wait(&mutex);
+            continue;
+        }
+        Task* task = ready;
+        ready = task->next_ready;
+        if (!ready) {
+            ready_last = NULL;
+        }
+        lock.unlock();
+        task->execute();
+        lock.relock();
+        --remaining;
+        bool woke = false;
+        for (Task::Edge* edge = task->dependents; edge; edge = edge->next) {
+            if (!--edge->task->pending) {
+                push(edge->task);
+                woke = true;
+            }
+        }
+        if (woke || !remaining) {
+            wakeup.wakeAll();
+        }
+    }
+}
\ No newline at end of file
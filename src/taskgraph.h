@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QRunnable>
+#include <QVector>
+
+#include <new>
+
+#include "arena.h"
+
+namespace gl {
+    /*
+     * Tasks of a frame and the order between them, kept in the arena of the frame. A task runs once every
+     * task it depends on is done, so independent work of different passes overlaps. run() works on the ready
+     * tasks itself while helpers on the global thread pool take them from the same queue; helpers the pool has
+     * not started when the work is done are taken back, so a graph run from a pool thread still finishes when
+     * the pool is busy. The helpers are kept for the next run, which does not touch the heap.
+     */
+    class TaskGraph {
+    public:
+        class Task {
+        public:
+            virtual void execute() = 0;
+        private:
+            friend class TaskGraph;
+            class Edge {
+            public:
+                Task* task;
+                Edge* next;
+            };
+
+            /* Dependencies not done yet */
+            int pending;
+            Edge* dependents;
+            Edge* last_dependent;
+            Task* next;
+            Task* next_ready;
+        };
+
+        TaskGraph(Arena* arena);
+        ~TaskGraph();
+        /* Forgets every task, call it whenever the arena is reset */
+        void clear();
+        /* A task calling function(), which is never destroyed and must only capture plain data */
+        template<typename Function>
+        Task* add(Function function) {
+            Job<Function>* job = new (arena->alloc<Job<Function> >(1)) Job<Function>(function);
+            append(job);
+            return job;
+        }
+        /* task starts after dependency is done */
+        void depend(Task* task, Task* dependency);
+        /* Returns when every task is done */
+        void run();
+    private:
+        template<typename Function>
+        class Job: public Task {
+        public:
+            Job(Function function): function(function) {}
+            virtual void execute() {
+                function();
+            }
+        private:
+            Function function;
+        };
+        class Helper: public QRunnable {
+        public:
+            Helper(TaskGraph* graph);
+            virtual void run();
+        private:
+            TaskGraph* graph;
+        };
+
+        TaskGraph(const TaskGraph&);
+        TaskGraph& operator=(const TaskGraph&);
+        void append(Task* task);
+        void push(Task* task);
+        /* Runs ready tasks until the graph is done */
+        void work();
+
+        Arena* arena;
+        /* In the order they were added, which is the order they run in without helpers */
+        Task* first;
+        Task* last;
+        QMutex mutex;
+        QWaitCondition wakeup;
+        Task* ready;
+        Task* ready_last;
+        int remaining;
+        QVector<Helper*> helpers;
+        /* Helpers started and not finished yet */
+        int running;
+        QWaitCondition finished;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+QT += gui core concurrent
+QT -= widgets
+
+CONFIG += console c++11 testcase
+CONFIG -= app_bundle
+
+TARGET = golden-test
+
+include(../../src/core.pri)
+
+# Models, scenes and reference images are found relative to the source tree
+DEFINES += SOURCE_DIR=\\\"$$PWD/../..\\\"
+
+SOURCES += \
+	main.cpp 
+
+BUILD_DIR = $$OUT_PWD/build
+OBJECTS_DIR = $${BUILD_DIR}
+MOC_DIR = $${BUILD_DIR}
\ No newline at end of file
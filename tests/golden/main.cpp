@@ -0,0 +1,189 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStringList>
+#include <QImage>
+#include <QPoint>
+#include <QDir>
+
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+
+#include "scene.h"
+#include "renderer.h"
+#include "simplegl.h"
+
+#ifndef SOURCE_DIR
+#define SOURCE_DIR "."
+#endif
+
+namespace {
+    /* Channel differences up to THRESHOLD are rounding, a few such pixels along edges are expected */
+    const int THRESHOLD = 8;
+    const double MAX_MISMATCHED = 0.001;
+    const double MIN_PSNR = 40;
+
+    /* A reference view: what to load, where to look from and how to render it */
+    class View {
+    public:
+        View(const QString &name, const QString &scene = QString())
+                : name(name), scene(scene), orbit(0), samples(1), lod_error(1), ssao(0), shadow_depth(32) {}
+        QString name, scene;
+        /* Eye steps around the center, see Renderer::moveEye */
+        int orbit;
+        int samples;
+        float lod_error;
+        float ssao;
+        int shadow_depth;
+    };
+
+    QVector<View> views() {
+        QVector<View> res;
+        res.push_back(View("head"));
+        res.push_back(View("head_orbit"));
+        res.last().orbit = 8;
+        res.push_back(View("head_lod"));
+        res.last().lod_error = 50;
+        res.push_back(View("diablo", "scenes/diablo.scene"));
+        res.push_back(View("heads_msaa", "scenes/heads.scene"));
+        res.last().samples = 4;
+        res.push_back(View("portrait", "scenes/portrait.scene"));
+        res.push_back(View("heads_ssao", "scenes/heads.scene"));
+        res.last().ssao = 1;
+        return res;
+    }
+
+    /*
+     * The shadow bias hides fixed point depth in every view, so the depth of a shadow pass is compared directly:
+     * decoded fixed point must lie within one step of float depth and must not simply be float depth.
+     */
+    bool checkShadowDepth(const QDir &root, int bits) {
+        Model model(root.filePath("models/diablo3/diablo3_pose.obj").toStdString());
+        const int width = 400, height = 300;
+        gl::Arena arena;
+        gl::RenderContext context(gl::viewport_matrix(0, 0, width, height), gl::projection_matrix(0),
+                                  gl::lookat_matrix(Vec3f(1, 1, 1), Vec3f(0, 0, 0), Vec3f(0, 1, 0)), &arena);
+        context.model = &model;
+        DepthShader shader(context);
+        gl::DepthBuffer buffers[2];
+        for (int k = 0; k < 2; ++k) {
+            buffers[k].resize(width, height, k ? bits : 32);
+            buffers[k].clear(0, height - 1);
+            for (size_t i = 0; i < model.lodFaces(0); ++i) {
+                Matr<4, 3, float> clip_coords;
+                for (size_t j = 0; j < 3; ++j) {
+                    clip_coords.setCol(j, shader.vertex(i, j));
+                }
+                gl::triangle(context, clip_coords, shader, buffers[k]);
+            }
+        }
+        float step = 1 / buffers[1].scale(), max_error = 0;
+        int covered = 0, quantized = 0, wrong = 0;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                float exact = buffers[0].depth(x, y), fixed = buffers[1].depth(x, y);
+                if (exact == -std::numeric_limits<float>::max() || fixed == -std::numeric_limits<float>::max()) {
+                    wrong += exact != fixed;
+                    continue;
+                }
+                covered++;
+                /* Fixed point holds depths 0 to DEPTH only */
+                exact = std::min(std::max(exact, 0.0f), float(gl::DEPTH));
+                quantized += fixed != exact;
+                /* Float rounding of the encoded and decoded depth is allowed for, it matters at 24 bits */
+                float rounding = 2 * (std::nextafter(exact, std::numeric_limits<float>::max()) - exact);
+                float error = std::abs(exact - fixed);
+                wrong += error > step + rounding;
+                max_error = std::max(max_error, error / step);
+            }
+        }
+        bool ok = covered && quantized && !wrong;
+        printf("%s shadow_depth%d max error %.3f steps, %d of %d pixels quantized, %d pixels wrong\n", ok ? "PASS" : "FAIL",
+               bits, max_error, quantized, covered, wrong);
+        return ok;
+    }
+
+    QImage render(const View &view, const QDir &root, int width, int height) {
+        Scene scene;
+        if (view.scene.isEmpty()) {
+            scene.addInstance(scene.addModel(root.filePath("models/african_head/african_head.obj")));
+            scene.addInstance(scene.addModel(root.filePath("models/african_head/african_head_eye_inner.obj")));
+        } else if (!scene.load(root.filePath(view.scene))) {
+            return QImage();
+        }
+        scene.waitForAssets();
+        Renderer renderer(&scene, width, height);
+        renderer.setSamples(view.samples);
+        renderer.setLodThreshold(view.lod_error);
+        renderer.setAmbientOcclusion(view.ssao);
+        renderer.setShadowDepth(view.shadow_depth);
+        if (view.orbit) {
+            renderer.moveEye(QPoint(view.orbit, 0));
+        }
+        return renderer.genFrame();
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders reference views and compares them with the stored golden images.");
+    parser.addHelpOption();
+    QCommandLineOption root_option("root", "Source tree with models/, scenes/ and tests/golden/images/.", "dir", SOURCE_DIR);
+    parser.addOption(root_option);
+    QCommandLineOption update_option("update", "Overwrite the golden images with the current output.");
+    parser.addOption(update_option);
+    QCommandLineOption output_option("output", "Write actual and difference images of failed views to <dir>.", "dir", "golden-failures");
+    parser.addOption(output_option);
+    parser.process(app);
+
+    QDir root(parser.value(root_option));
+    QDir images(root.filePath("tests/golden/images"));
+    QDir output(parser.value(output_option));
+    QVector<View> list = views();
+    int failed = 0;
+    for (int i = 0; i < list.size(); ++i) {
+        const View &view = list[i];
+        QString golden_file = images.filePath(view.name + ".png");
+        QImage golden(golden_file);
+        QImage actual = render(view, root, golden.isNull() ? 400 : golden.width(), golden.isNull() ? 300 : golden.height());
+        if (actual.isNull()) {
+            printf("FAIL %-12s could not render\n", view.name.toLocal8Bit().constData());
+            failed++;
+            continue;
+        }
+        if (parser.isSet(update_option)) {
+            if (!actual.save(golden_file)) {
+                std::cerr << "can't write " << golden_file.toStdString() << "\n";
+                failed++;
+            }
+            printf("SAVE %s\n", golden_file.toLocal8Bit().constData());
+            continue;
+        }
+        if (golden.isNull()) {
+            printf("FAIL %-12s no golden image %s, run with --update\n", view.name.toLocal8Bit().constData(),
+                   golden_file.toLocal8Bit().constData());
+            failed++;
+            continue;
+        }
+        ImageDiff diff = gl::compare(golden, actual, THRESHOLD);
+        bool ok = diff.mismatched <= MAX_MISMATCHED * diff.pixels && diff.psnr >= MIN_PSNR;
+        printf("%s %-12s psnr %6.2f dB, max error %3d, mean error %.4f, %d pixels off by more than %d\n",
+               ok ? "PASS" : "FAIL", view.name.toLocal8Bit().constData(), diff.psnr, diff.max_error, diff.mean_error,
+               diff.mismatched, THRESHOLD);
+        if (!ok) {
+            failed++;
+            output.mkpath(".");
+            actual.save(output.filePath(view.name + "_actual.png"));
+            gl::diff(golden, actual).save(output.filePath(view.name + "_diff.png"));
+        }
+    }
+    int bits[] = {16, 24};
+    for (int i = 0; i < 2; ++i) {
+        failed += !checkShadowDepth(root, bits[i]);
+    }
+    printf("%d of %d checks failed\n", failed, list.size() + 2);
+    return failed ? 1 : 0;
+}
\ No newline at end of file